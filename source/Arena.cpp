@@ -0,0 +1,74 @@
+#include "Arena.hpp"
+#include "HeapCounter.hpp" // counting our mallocs
+#include <algorithm>       // std::max
+#include <cassert>
+#include <cstdlib> // std::malloc, std::free
+#include <omp.h>   // OpenMP
+
+// declaring static variables
+std::vector<Arena::Block> Arena::Blocks;
+
+void Arena::Init()
+{
+    const size_t NumThreads = std::max(1, GlobalParams.SimulatorParams.NumThreads);
+    Reset(); // (frees any earlier arenas)
+    for (Block &B : Blocks)
+    {
+        std::free(B.Data);
+    }
+    Blocks = std::vector<Block>(NumThreads);
+    const size_t InitialSize = 64 * 1024;
+    for (Block &B : Blocks)
+    {
+        B.Data = static_cast<char *>(std::malloc(InitialSize));
+        HeapCounter::Count();
+        B.Size = (B.Data != nullptr) ? InitialSize : 0;
+    }
+}
+
+void Arena::Reset()
+{
+    for (Block &B : Blocks)
+    {
+        for (char *Ptr : B.Overflow)
+        {
+            std::free(Ptr);
+        }
+        if (B.OverflowBytes > 0)
+        {
+            // grow (geometrically) so all of this tick's buffers fit next time
+            std::free(B.Data);
+            const size_t NewSize = 2 * (B.Size + B.OverflowBytes);
+            B.Data = static_cast<char *>(std::malloc(NewSize));
+            HeapCounter::Count();
+            B.Size = (B.Data != nullptr) ? NewSize : 0;
+        }
+        B.Overflow.clear();
+        B.OverflowBytes = 0;
+        B.Used = 0;
+    }
+}
+
+void *Arena::AllocBytes(const size_t Bytes, const size_t Align)
+{
+    /// NOTE: this is thread safe since every thread only touches its own block
+    // (and outside of parallel regions only the master thread runs)
+    const size_t TID = omp_get_thread_num();
+    assert(TID < Blocks.size());
+    assert(Align <= alignof(std::max_align_t)); // (malloc'd memory is this aligned)
+    Block &B = Blocks[TID];
+    const size_t Start = (B.Used + Align - 1) / Align * Align;
+    if (Start + Bytes <= B.Size)
+    {
+        B.Used = Start + Bytes;
+        return B.Data + Start;
+    }
+    // doesn't fit, fall back to the heap until the next reset
+    char *Ptr = static_cast<char *>(std::malloc(std::max(Bytes, size_t(1))));
+    HeapCounter::Count();
+    if (Ptr == nullptr)
+        throw std::bad_alloc();
+    B.Overflow.push_back(Ptr);
+    B.OverflowBytes += Bytes;
+    return Ptr;
+}
@@ -0,0 +1,36 @@
+#ifndef ARENA
+#define ARENA
+
+#include "Utils.hpp"   // Params
+#include <cstddef>     // size_t
+#include <type_traits> // std::is_trivially_destructible
+#include <vector>      // std::vector
+
+class Arena // per-thread bump allocators for the buffers that only live for one tick
+{
+  public:
+    static void Init();
+    // frees everything allocated since the last reset (must not be called in parallel)
+    static void Reset();
+    // uninitialized space for N Ts from the calling thread's arena
+    template <typename T> static T *Alloc(const size_t N)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+        return static_cast<T *>(AllocBytes(N * sizeof(T), alignof(T)));
+    }
+
+  private:
+    static void *AllocBytes(const size_t Bytes, const size_t Align);
+    struct Block
+    {
+        char *Data = nullptr;
+        size_t Size = 0, Used = 0;
+        // what didn't fit in Data this tick, Data grows to fit it all on the next reset
+        std::vector<char *> Overflow;
+        size_t OverflowBytes = 0;
+        char Padding[64]; // so threads don't share cache lines
+    };
+    static std::vector<Block> Blocks; // one per thread
+};
+
+#endif
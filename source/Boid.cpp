@@ -1,6 +1,10 @@
 #include "Boid.hpp"
-#include "Flock.hpp"  // To see all other neighbourhoods
-#include "Tracer.hpp" // to keep track of memory traces
+#include "Flock.hpp"      // To see all other neighbourhoods
+#include "FlockMap.hpp"   // To find our own flock
+#include "Grid.hpp"       // To see the nearby cells
+#include "PlanKernel.hpp" // batched planning over the SoA
+#include "Tracer.hpp"     // to keep track of memory traces
+#include "Verlet.hpp"     // To see the cached neighbours
 #include <unordered_set>
 
 // declaring static variables
@@ -21,65 +25,152 @@ size_t Boid::GetFlockID() const
     return FlockID;
 }
 
-void Boid::SenseAndPlan(const int TID, const std::unordered_map<size_t, Flock> &AllFlocks)
+size_t Boid::SenseAndPlan(const int TID, const FlockMap &AllFlocks)
 {
-    // reset current force factors
     assert(IsValid());
+    Vec2D RelCOM, RelCOV, Sep; // relative center-of-mass/velocity, & separation
+    size_t NumCloseby = 0;
+    const size_t NumSensed = Sense(TID, AllFlocks, RelCOM, RelCOV, Sep, NumCloseby);
+    SetForces(RelCOM, RelCOV, Sep, NumCloseby);
+    return NumSensed;
+}
+
+void Boid::SetForces(const Vec2D &RelCOM, const Vec2D &RelCOV, const Vec2D &Sep, const size_t NumCloseby)
+{
+    // reset current force factors
     a1 = Vec2D(0, 0);
     a2 = Vec2D(0, 0);
     a3 = Vec2D(0, 0);
-    Vec2D RelCOM, RelCOV, Sep; // relative center-of-mass/velocity, & separation
+    if (NumCloseby > 0)
+    {
+        a1 = ((RelCOM / NumCloseby) - Position) * Params.Cohesion;
+        a2 = Sep * Params.Separation; // dosent depent on NumCloseby but makes sense
+        a3 = ((RelCOV / NumCloseby) - Velocity) * Params.Alignment;
+    }
+}
+
+size_t Boid::SenseAndAct(const int TID, const FlockMap &AllFlocks, const float DeltaTime)
+{
+    /// NOTE: the forces are used as soon as they are planned (so never stored), which is
+    // only correct because everyone senses last tick's state while this writes the next
+    // tick's (see NLayout::IsDoubleBuffered)
+    assert(IsValid() && NLayout::IsDoubleBuffered());
+    Vec2D RelCOM, RelCOV, Sep;
     size_t NumCloseby = 0;
-    auto It = AllFlocks.find(FlockID);
-    assert(It != AllFlocks.end());
-    const Flock &ThisFlock = It->second;
-    // begin sensing all other boids in all other flocks
-    ThreadID = TID;
-    for (auto It = AllFlocks.begin(); It != AllFlocks.end(); It++)
+    const size_t NumSensed = Sense(TID, AllFlocks, RelCOM, RelCOV, Sep, NumCloseby);
+    Acceleration = Vec2D(0, 0);
+    if (NumCloseby > 0)
     {
-        assert(It != AllFlocks.end());
-        const Flock &F = It->second;
+        // (the same forces as SenseAndPlan, summed in the same order as Act)
+        const Vec2D Cohesion = ((RelCOM / NumCloseby) - Position) * Params.Cohesion;
+        const Vec2D Separation = Sep * Params.Separation;
+        const Vec2D Alignment = ((RelCOV / NumCloseby) - Velocity) * Params.Alignment;
+        Acceleration = Cohesion + Separation + Alignment;
+    }
+    Velocity = (Velocity + Acceleration).LimitMagnitude(Params.MaxVel);
+    Position += Velocity * DeltaTime;
+    NLayout::StoreNextSoA(*this); // only sensed once the buffers are swapped
+    return NumSensed;
+}
 
-        assert(F.IsValidFlock());
-        // if flock is close enough (correct bc bounding boxes)
-        // after extending our BB
-        if (F.BB.IntersectsBB(ThisFlock.BB, Params.NeighbourhoodRadius))
+size_t Boid::Sense(const int TID, const FlockMap &AllFlocks, Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep,
+                   size_t &NumCloseby)
+{
+    size_t NumSensed = 0;
+    ThreadID = TID;
+    if (VerletList::IsEnabled())
+    {
+        // only sense the boids that were close enough when the lists were built
+        const BoidSoA &SoA = NLayout::GetSoA();
+        const size_t *Begin = VerletList::Begin(BoidID);
+        const size_t *End = VerletList::End(BoidID);
+#ifndef NTRACE
+        for (const size_t *It = Begin; It != End; It++)
+        {
+            Tracer::AddRead(GetFlockID(), SoA.FlockIDs[*It], Flock::SenseAndPlanOp);
+        }
+#endif
+        PlanKernel::PlanGather(SoA, Begin, End - Begin, Position, BoidID, RelCOM, RelCOV, Sep, NumCloseby);
+        NumSensed = End - Begin;
+    }
+    else if (SpatialGrid::IsEnabled())
+    {
+        // only sense the boids in the cells around us
+        NumSensed = SenseAndPlanGrid(RelCOM, RelCOV, Sep, NumCloseby);
+    }
+    else
+    {
+        const Flock *ThisFlockPtr = AllFlocks.Find(FlockID); // O(1), no hashing
+        assert(ThisFlockPtr != nullptr);
+        const Flock &ThisFlock = *ThisFlockPtr;
+        // begin sensing all other boids in the flocks close enough to ours
+        // (correct bc the broad phase checked their extended bounding boxes)
+        for (size_t n = 0; n < ThisFlock.NumNearby; n++)
         {
-            std::vector<Boid *> Boids = F.Neighbourhood.GetBoids();
-            for (const Boid *B : Boids)
+            const Flock &F = *ThisFlock.NearbyFlocks[n];
+            assert(F.IsValidFlock());
+            NumSensed += F.Size();
+            // only read the hot state of the flock's boids (from the SoA, which is also
+            // last tick's state when the boids' structs already hold their next one)
+            const BoidSoA &SoA = NLayout::GetSoA();
+            const size_t *IDs = F.Neighbourhood.GetBoidIDs();
+#ifndef NTRACE
+            for (size_t i = 0; i < F.Size(); i++)
             {
-                // begin planning for this boid for each boid that is sensed
-                Plan((*B), RelCOM, RelCOV, Sep, NumCloseby);
+                Tracer::AddRead(GetFlockID(), SoA.FlockIDs[IDs[i]], Flock::SenseAndPlanOp);
             }
+#endif
+            PlanKernel::PlanGather(SoA, IDs, F.Size(), Position, BoidID, RelCOM, RelCOV, Sep, NumCloseby);
         }
     }
+    return NumSensed;
+}
 
-    if (NumCloseby > 0)
-    {
-        a1 = ((RelCOM / NumCloseby) - Position) * Params.Cohesion;
-        a2 = Sep * Params.Separation; // dosent depent on NumCloseby but makes sense
-        a3 = ((RelCOV / NumCloseby) - Velocity) * Params.Alignment;
-    }
+size_t Boid::SenseAndPlanGrid(Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep, size_t &NumCloseby) const
+{
+    /// NOTE: the grid cells are at least NeighbourhoodRadius wide, so every
+    // neighbour lies within the 3x3 block of cells around this boid
+    const BoidSoA &Cells = SpatialGrid::GetCells();
+    size_t NumSensed = 0;
+    SpatialGrid::ForEachRow(Position, 1, [&](const size_t Begin, const size_t End) {
+        NumSensed += End - Begin;
+        // cells within a row are contiguous in the grid
+#ifndef NTRACE
+        for (size_t i = Begin; i < End; i++)
+        {
+            Tracer::AddRead(GetFlockID(), Cells.FlockIDs[i], Flock::SenseAndPlanOp);
+        }
+#endif
+        PlanKernel::Plan(Cells, Begin, End, Position, BoidID, RelCOM, RelCOV, Sep, NumCloseby);
+    });
+    return NumSensed;
 }
 
 void Boid::Plan(const Boid &B, Vec2D &RelativeCOM, Vec2D &AvgVel, Vec2D &SeparationDisp, size_t &NumCloseby) const
+{
+    Plan(B.Position, B.Velocity, B.BoidID, B.GetFlockID(), RelativeCOM, AvgVel, SeparationDisp, NumCloseby);
+}
+
+void Boid::Plan(const Vec2D &BPos, const Vec2D &BVel, const size_t BBoidID, const size_t BFlockID,
+                Vec2D &RelativeCOM, Vec2D &AvgVel, Vec2D &SeparationDisp, size_t &NumCloseby) const
 {
     assert(IsValid());
     // add to the tracer
-    Tracer::AddRead(GetFlockID(), B.GetFlockID(), Flock::SenseAndPlanOp);
+    Tracer::AddRead(GetFlockID(), BFlockID, Flock::SenseAndPlanOp);
 
-    if (B.BoidID == BoidID)
+    if (BBoidID == BoidID)
         return; // don't plan with self
 
-    if (DistanceGT(B, Params.NeighbourhoodRadius))
+    const float DistSqr = (Position - BPos).SizeSqr();
+    if (DistSqr > sqr(Params.NeighbourhoodRadius))
         return; // too far away: ignore
 
     // Makes local decisions based off the current neighbours
     /// NOTE: (all logic is done on the current velocity/positions which are read-only)
-    RelativeCOM += B.Position; // contribute to relative center-of-mass
-    AvgVel += B.Velocity;      // contribute to average velocity
-    if (DistanceLT(B, Params.CollisionRadius))
-        SeparationDisp -= (B.Position - Position); // contribute to displacement
+    RelativeCOM += BPos; // contribute to relative center-of-mass
+    AvgVel += BVel;      // contribute to average velocity
+    if (DistSqr < sqr(Params.CollisionRadius))
+        SeparationDisp -= (BPos - Position); // contribute to displacement
     // Finally increment the count for number of closeby boids
     NumCloseby++;
 }
@@ -90,6 +181,12 @@ void Boid::Act(const float DeltaTime)
     /// NOTE: This function is meant to be independent from all other boids
     /// and thus can be run asynchronously, however it needs a barrier between itself
     /// and the Boid::Plan() function
+    Move(DeltaTime);
+    NLayout::StoreSoA(*this); // write through to the hot state
+}
+
+void Boid::Move(const float DeltaTime)
+{
     Acceleration = a1 + a2 + a3; // + a4
     Velocity = (Velocity + Acceleration).LimitMagnitude(Params.MaxVel);
     Position += Velocity * DeltaTime;
@@ -108,24 +205,29 @@ void Boid::CollisionCheck(Boid &Neighbour)
     }
 }
 
-void Boid::Draw(Image &I) const
+Colour Boid::GetColour() const
 {
-    assert(IsValid());
-    Colour C(255, 255, 255);
     if (Params.ColourByThread)
     {
-        C = IDColours[ThreadID % IDColours.size()];
+        return IDColours[ThreadID % IDColours.size()];
     }
-    else
-    {
-        C = IDColours[FlockID % IDColours.size()];
-    }
-    I.DrawSolidCircle(Position, Params.Radius, C);
+    return IDColours[FlockID % IDColours.size()];
+}
+
+void Boid::Draw(Image &I) const
+{
+    assert(IsValid());
+    Draw(I, Position, Velocity, GetColour());
+}
+
+void Boid::Draw(Image &I, const Vec2D &Pos, const Vec2D &Vel, const Colour &C, const Image::Clip &R)
+{
+    I.DrawSolidCircle(Pos, Params.Radius, C, R);
     // also render line to indicate direction
     const size_t LineWidth = 2 * Params.Radius; // number pixels
-    Vec2D Heading = Velocity.Norm();
-    Vec2D End = Position + Heading * LineWidth;
-    I.DrawLine(Position, End, C);
+    Vec2D Heading = Vel.Norm();
+    Vec2D End = Pos + Heading * LineWidth;
+    I.DrawLine(Pos, End, C, R);
 }
 
 void Boid::EdgeWrap()
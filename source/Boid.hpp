@@ -9,6 +9,7 @@
 
 // fwd declaration of flocks
 class Flock;
+class FlockMap;
 
 class Boid
 {
@@ -50,16 +51,40 @@ class Boid
 
     size_t GetFlockID() const;
 
-    void SenseAndPlan(const int TID, const std::unordered_map<size_t, Flock> &AllFlocks);
+    // returns how many boids were sensed (ie. how much work it was)
+    size_t SenseAndPlan(const int TID, const FlockMap &AllFlocks);
+
+    // plans & acts right away (only with double buffered state, see NLayout)
+    size_t SenseAndAct(const int TID, const FlockMap &AllFlocks, const float DeltaTime);
+
+    // accumulates the neighbours' contributions to the forces
+    size_t Sense(const int TID, const FlockMap &AllFlocks, Vec2D &RCOM, Vec2D &RCOV, Vec2D &Sep, size_t &NC);
+
+    size_t SenseAndPlanGrid(Vec2D &RCOM, Vec2D &RCOV, Vec2D &Sep, size_t &NC) const;
 
     void Plan(const Boid &B, Vec2D &RCOM, Vec2D &RCOV, Vec2D &Sep, size_t &NC) const;
 
+    void Plan(const Vec2D &BPos, const Vec2D &BVel, const size_t BBoidID, const size_t BFlockID, Vec2D &RCOM,
+              Vec2D &RCOV, Vec2D &Sep, size_t &NC) const;
+
+    // turns the neighbours' contributions into the force factors (a1, a2, a3)
+    void SetForces(const Vec2D &RCOM, const Vec2D &RCOV, const Vec2D &Sep, const size_t NC);
+
     void Act(const float DeltaTime);
 
+    // Act without writing through to the hot state (for boids outside of any NLayout)
+    void Move(const float DeltaTime);
+
     void CollisionCheck(Boid &B);
 
+    Colour GetColour() const;
+
     void Draw(Image &I) const;
 
+    // (also draws boids from a snapshot, see RenderQueue)
+    static void Draw(Image &I, const Vec2D &Pos, const Vec2D &Vel, const Colour &C,
+                     const Image::Clip &R = Image::Clip());
+
     void EdgeWrap();
 
     bool DistanceLT(const Boid &B, const float Rad) const;
@@ -0,0 +1,90 @@
+#include "CellList.hpp"
+#include "Grid.hpp"       // SpatialGrid (cell coordinates)
+#include "PlanKernel.hpp" // SIMD kernels
+#include <algorithm>      // std::sort, std::min, std::max
+
+void CellList::Clear()
+{
+    Boids.Resize(0);
+}
+
+void CellList::Add(const float X, const float Y, const float VX, const float VY, const size_t BoidID)
+{
+    Boids.X.push_back(X);
+    Boids.Y.push_back(Y);
+    Boids.VX.push_back(VX);
+    Boids.VY.push_back(VY);
+    Boids.FlockIDs.push_back(BoidID); // (unused)
+    Boids.BoidIDs.push_back(BoidID);
+}
+
+void CellList::Build()
+{
+    const size_t N = Boids.Size();
+    // only as many cells as the added boids span
+    size_t MinX = ~size_t(0), MinY = ~size_t(0), MaxX = 0, MaxY = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        size_t CX, CY;
+        SpatialGrid::CellCoords(Vec2D(Boids.X[i], Boids.Y[i]), CX, CY);
+        MinX = std::min(MinX, CX);
+        MinY = std::min(MinY, CY);
+        MaxX = std::max(MaxX, CX);
+        MaxY = std::max(MaxY, CY);
+    }
+    CellX0 = (N > 0) ? MinX : 0;
+    CellY0 = (N > 0) ? MinY : 0;
+    NumCellsX = (N > 0) ? MaxX - MinX + 1 : 1;
+    NumCellsY = (N > 0) ? MaxY - MinY + 1 : 1;
+    Keys.resize(N);
+    Order.resize(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        Keys[i] = LocalCell(Vec2D(Boids.X[i], Boids.Y[i]));
+        Order[i] = i;
+    }
+    std::sort(Order.begin(), Order.end(), [this](const size_t A, const size_t B) {
+        if (Keys[A] != Keys[B])
+            return Keys[A] < Keys[B];
+        return Boids.BoidIDs[A] < Boids.BoidIDs[B];
+    });
+    Sorted.Resize(N);
+    CellStart.assign(NumCellsX * NumCellsY + 1, 0);
+    for (size_t i = 0; i < N; i++)
+    {
+        Sorted.Copy(i, Boids, Order[i]);
+        CellStart[Keys[Order[i]] + 1]++;
+    }
+    for (size_t c = 0; c < NumCellsX * NumCellsY; c++)
+    {
+        CellStart[c + 1] += CellStart[c]; // prefix sum
+    }
+    std::swap(Boids, Sorted);
+}
+
+size_t CellList::LocalCell(const Vec2D &Pos) const
+{
+    size_t CX, CY;
+    SpatialGrid::CellCoords(Pos, CX, CY);
+    assert(CX >= CellX0 && CX - CellX0 < NumCellsX && CY >= CellY0 && CY - CellY0 < NumCellsY);
+    return (CX - CellX0) + (CY - CellY0) * NumCellsX;
+}
+
+void CellList::Plan(const Vec2D &Pos, const size_t BoidID, Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep,
+                    size_t &NumCloseby) const
+{
+    // (just like SpatialGrid::ForEachRow, clipped to the cells we have)
+    size_t CX, CY;
+    SpatialGrid::CellCoords(Pos, CX, CY);
+    assert(CX >= CellX0 && CY >= CellY0);
+    const size_t MinX = std::max(CX, CellX0 + 1) - 1 - CellX0;
+    const size_t MinY = std::max(CY, CellY0 + 1) - 1 - CellY0;
+    const size_t MaxX = std::min(CX + 1 - CellX0, NumCellsX - 1);
+    const size_t MaxY = std::min(CY + 1 - CellY0, NumCellsY - 1);
+    for (size_t Y = MinY; Y <= MaxY; Y++)
+    {
+        const size_t Begin = CellStart[MinX + Y * NumCellsX];
+        const size_t End = CellStart[MaxX + Y * NumCellsX + 1];
+        PlanKernel::Plan(Boids, Begin, End, Pos, BoidID, RelCOM, RelCOV, Sep, NumCloseby);
+    }
+}
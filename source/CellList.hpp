@@ -0,0 +1,37 @@
+#ifndef CELL_LIST
+#define CELL_LIST
+
+#include "Neighbourhood.hpp" // BoidSoA
+#include "Utils.hpp"         // Params
+#include "Vec.hpp"           // Vec2D
+#include <vector>            // std::vector
+
+class CellList // some of the boids (ie. a process' part of the world & its halo) sorted by grid cell
+{
+  public:
+    /// NOTE: the cells are those of the SpatialGrid (which must be initialized), so a
+    // boid senses its neighbours in the same order no matter which subset it is in
+    void Clear();
+    void Add(const float X, const float Y, const float VX, const float VY, const size_t BoidID);
+    // sort the added boids by cell, then by BoidID
+    void Build();
+    size_t Size() const
+    {
+        return Boids.Size();
+    }
+    // plan against the boids in the 3x3 cells around Pos (which must be one of the
+    // added boids, or at least lie within their cells)
+    void Plan(const Vec2D &Pos, const size_t BoidID, Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep,
+              size_t &NumCloseby) const;
+
+  private:
+    size_t LocalCell(const Vec2D &Pos) const;
+    BoidSoA Boids, Sorted;
+    std::vector<size_t> Keys, Order;
+    // CellStart[c] is the first index of (local) cell c in Boids (CSR style), where the
+    // local cells are the grid's cells [CellX0, CellX0 + NumCellsX) x [CellY0, ...)
+    std::vector<size_t> CellStart;
+    size_t CellX0 = 0, CellY0 = 0, NumCellsX = 1, NumCellsY = 1;
+};
+
+#endif
@@ -1,7 +1,12 @@
 #include "Flock.hpp"
+#include "Arena.hpp"
+#include "FlockMap.hpp"
+#include "Grid.hpp"
+#include "Morton.hpp"
 #include "Tracer.hpp"
 #include <algorithm>
 #include <cassert>
+#include <omp.h>
 
 // declaring static variables
 FlockParamsStruct Flock::Params;
@@ -18,122 +23,258 @@ size_t Flock::Size() const
     return Neighbourhood.Size();
 }
 
-void Flock::SenseAndPlan(const int TID, const std::unordered_map<size_t, Flock> &AllFlocks)
+void Flock::SenseAndPlan(const int TID, const FlockMap &AllFlocks)
 {
     assert(IsValidFlock()); // make sure this flock is valid
     // assert(NLayout::GetType() == NLayout::Local); // only on Local type
     TIDs.SenseAndPlan = TID;
-    std::vector<Boid *> Boids = Neighbourhood.GetBoids();
-    for (Boid *B : Boids)
+    const size_t N = Size();
+    if (Params.SplitSize == 0 || N <= Params.SplitSize)
     {
-        B->SenseAndPlan(TID, AllFlocks);
+        Interactions = SenseAndPlan(TID, AllFlocks, 0, N);
+        return;
     }
+    /// NOTE: oversized flocks are split into boid ranges (as nested tasks) so idle
+    // threads can help with them, while small flocks stay whole (for locality)
+    size_t Total = 0;
+    for (size_t Begin = 0; Begin < N; Begin += Params.SplitSize)
+    {
+        const size_t End = std::min(Begin + Params.SplitSize, N);
+#pragma omp task firstprivate(Begin, End) shared(Total, AllFlocks)
+        {
+            const size_t NumSensed = SenseAndPlan(omp_get_thread_num(), AllFlocks, Begin, End);
+#pragma omp atomic
+            Total += NumSensed;
+        }
+    }
+#pragma omp taskwait
+    Interactions = Total;
+}
+
+size_t Flock::SenseAndPlan(const int TID, const FlockMap &AllFlocks, const size_t Begin, const size_t End)
+{
+    const BoidRange Boids = Neighbourhood.GetBoids();
+    assert(Begin <= End && End <= Boids.Size());
+    size_t NumSensed = 0;
+    for (size_t b = Begin; b < End; b++)
+    {
+        NumSensed += Boids[b]->SenseAndPlan(TID, AllFlocks);
+    }
+    return NumSensed;
 }
 
 void Flock::Act(const float DeltaTime)
 {
     // all boids advance one timestep, can be done asynrhconously bc indep
     assert(IsValidFlock()); // make sure this flock is valid
-    std::vector<Boid *> Boids = Neighbourhood.GetBoids();
-    for (Boid *B : Boids)
+    const size_t N = Size();
+    Acted = true;
+    if (Params.SplitSize == 0 || N <= Params.SplitSize)
     {
-        B->Act(DeltaTime);
+        ActBounds = Act(DeltaTime, 0, N);
+        return;
+    }
+    // (split just like SenseAndPlan, with every range bounding its own boids)
+    const size_t NumRanges = (N + Params.SplitSize - 1) / Params.SplitSize;
+    BoundingBox *Bounds = Arena::Alloc<BoundingBox>(NumRanges);
+    for (size_t r = 0; r < NumRanges; r++)
+    {
+        const size_t Begin = r * Params.SplitSize;
+        const size_t End = std::min(Begin + Params.SplitSize, N);
+#pragma omp task firstprivate(r, Begin, End)
+        Bounds[r] = Act(DeltaTime, Begin, End);
+    }
+#pragma omp taskwait
+    ActBounds = BoundingBox::Empty();
+    for (size_t r = 0; r < NumRanges; r++)
+    {
+        ActBounds.Extend(Bounds[r]);
     }
 }
 
-void Flock::Delegate(const int TID, const std::vector<Flock *> &AllFlocks)
+Flock::BoundingBox Flock::Act(const float DeltaTime, const size_t Begin, const size_t End)
 {
-    assert(IsValidFlock()); // make sure this flock is valid
-    TIDs.Delegate = TID;
+    /// NOTE: one pass over the boids both moves them and does everything that needs
+    // their new positions: bounding them (for ComputeBB) and finding their grid cells
+    // (for the next tick's SpatialGrid::Rebuild)
+    const BoidRange Boids = Neighbourhood.GetBoids();
+    assert(Begin <= End && End <= Boids.Size());
+    const bool Bin = SpatialGrid::CanBin();
+    BoundingBox Bounds = BoundingBox::Empty();
+    for (size_t b = Begin; b < End; b++)
+    {
+        Boid *B = Boids[b];
+        B->Act(DeltaTime);
+        Bounds.Extend(B->Position);
+        if (Bin)
+            SpatialGrid::Bin(B->BoidID, B->Position);
+    }
+    return Bounds;
+}
 
-    // clear buckets from last Delegation
-    Emigrants.clear(); // if not done first, may get float counting later
+void Flock::SenseAndAct(const int TID, const FlockMap &AllFlocks, const float DeltaTime)
+{
+    /// NOTE: with double buffered state nobody senses what Act writes until the next
+    // tick, so every boid can act as soon as it has planned (see Boid::SenseAndAct)
+    assert(IsValidFlock() && NLayout::IsDoubleBuffered());
+    TIDs.SenseAndPlan = TID;
+    const size_t N = Size();
+    Acted = true;
+    if (Params.SplitSize == 0 || N <= Params.SplitSize)
+    {
+        ActBounds = SenseAndAct(TID, AllFlocks, DeltaTime, 0, N, Interactions);
+        return;
+    }
+    // (split just like SenseAndPlan & Act)
+    const size_t NumRanges = (N + Params.SplitSize - 1) / Params.SplitSize;
+    BoundingBox *Bounds = Arena::Alloc<BoundingBox>(NumRanges);
+    size_t *NumSensed = Arena::Alloc<size_t>(NumRanges);
+    for (size_t r = 0; r < NumRanges; r++)
+    {
+        const size_t Begin = r * Params.SplitSize;
+        const size_t End = std::min(Begin + Params.SplitSize, N);
+#pragma omp task firstprivate(r, Begin, End) shared(AllFlocks)
+        Bounds[r] = SenseAndAct(omp_get_thread_num(), AllFlocks, DeltaTime, Begin, End, NumSensed[r]);
+    }
+#pragma omp taskwait
+    ActBounds = BoundingBox::Empty();
+    Interactions = 0;
+    for (size_t r = 0; r < NumRanges; r++)
+    {
+        ActBounds.Extend(Bounds[r]);
+        Interactions += NumSensed[r];
+    }
+}
 
-    // clear nearby flocks
-    NearbyFlocks.clear();
+Flock::BoundingBox Flock::SenseAndAct(const int TID, const FlockMap &AllFlocks, const float DeltaTime,
+                                      const size_t Begin, const size_t End, size_t &NumSensed)
+{
+    const BoidRange Boids = Neighbourhood.GetBoids();
+    assert(Begin <= End && End <= Boids.Size());
+    const bool Bin = SpatialGrid::CanBin();
+    BoundingBox Bounds = BoundingBox::Empty();
+    NumSensed = 0;
+    for (size_t b = Begin; b < End; b++)
+    {
+        Boid *B = Boids[b];
+        NumSensed += B->SenseAndAct(TID, AllFlocks, DeltaTime);
+        Bounds.Extend(B->Position);
+        if (Bin)
+            SpatialGrid::Bin(B->BoidID, B->Position);
+    }
+    return Bounds;
+}
 
-    const std::vector<Flock *> &ClosestFlocks = AllFlocks;
-    // const std::vector<Flock *> ClosestFlocks = NearestFlocks(AllFlocks);
+void Flock::Delegate(const int TID)
+{
+    assert(IsValidFlock()); // make sure this flock is valid
+    TIDs.Delegate = TID;
 
     // Look through our neighbourhood
-    const std::vector<Boid *> Boids = Neighbourhood.GetBoids();
-    std::vector<std::pair<float, size_t>> BestBoidFlocks(Boids.size(),                // corresponding to Boids
-                                                         std::make_pair(0, FlockID)); // this flock
-    for (const Flock *F : ClosestFlocks)
+    const BoidRange Boids = Neighbourhood.GetBoids();
+    // (every boid leaves at most once, so this never needs to grow)
+    Emigrants = Arena::Alloc<std::pair<size_t, size_t>>(Boids.Size());
+    NumEmigrants = 0; // if not done first, may get float counting later
+    // best (rule, FlockID) of every boid in Boids, starting with this flock
+    float *BestRule = Arena::Alloc<float>(Boids.Size());
+    size_t *BestFlock = Arena::Alloc<size_t>(Boids.Size());
+    std::fill(BestRule, BestRule + Boids.Size(), 0.f);
+    std::fill(BestFlock, BestFlock + Boids.Size(), FlockID);
+    // only the flocks found by the broad phase can be close enough
+    for (size_t n = 0; n < NumNearby; n++)
     {
+        const Flock *F = NearbyFlocks[n];
         Tracer::AddRead(FlockID, F->FlockID, Flock::DelegateOp);
-        if (F->BB.IntersectsBB(BB, GlobalParams.BoidParams.NeighbourhoodRadius))
+        const BoidRange FBoids = F->Neighbourhood.GetBoids();
+        for (size_t b = 0; b < Boids.Size(); b++)
         {
-            NearbyFlocks.push_back(const_cast<Flock *>(F));
-            for (size_t b = 0; b < Boids.size(); b++)
+            const Boid *B = Boids[b];
+            for (const Boid *Peer : FBoids)
             {
-                const Boid *B = Boids[b];
-                std::vector<Boid *> FBoids = F->Neighbourhood.GetBoids();
-                for (const Boid *Peer : FBoids)
-                {
-                    if (Peer->BoidID == B->BoidID)
-                        continue; // skip self
-                    Tracer::AddRead(B->GetFlockID(), Peer->GetFlockID(), Flock::SenseAndPlanOp);
-                    const float Dist = B->DistanceTo((*Peer));
-                    /// NOTE: this is a very simple rule... only checking if
-                    // their flock is larger/eq, then I send them over there
-                    float FlockRule = 0;
-                    FlockRule += Params.WeightFlockSize * F->Size();
-                    if (Dist < B->Params.CollisionRadius && int(F->Size()) < Params.MaxSize)
-                        FlockRule += Params.WeightFlockDist * (1.0 / Dist);
-                    else
-                        FlockRule = 0; // ignore this Boid
+                if (Peer->BoidID == B->BoidID)
+                    continue; // skip self
+                Tracer::AddRead(B->GetFlockID(), Peer->GetFlockID(), Flock::SenseAndPlanOp);
+                const float Dist = B->DistanceTo((*Peer));
+                /// NOTE: this is a very simple rule... only checking if
+                // their flock is larger/eq, then I send them over there
+                float FlockRule = 0;
+                FlockRule += Params.WeightFlockSize * F->Size();
+                if (Dist < B->Params.CollisionRadius && int(F->Size()) < Params.MaxSize)
+                    FlockRule += Params.WeightFlockDist * (1.0 / Dist);
+                else
+                    FlockRule = 0; // ignore this Boid
 
-                    if (FlockRule > BestBoidFlocks[b].first)
-                    {
-                        // std::cout << Dist << std::endl;
-                        BestBoidFlocks[b] = std::make_pair(FlockRule, F->FlockID);
-                    }
+                if (FlockRule > BestRule[b])
+                {
+                    // std::cout << Dist << std::endl;
+                    BestRule[b] = FlockRule;
+                    BestFlock[b] = F->FlockID;
                 }
             }
         }
     }
-    for (size_t b = 0; b < Boids.size(); b++)
+    for (size_t b = 0; b < Boids.Size(); b++)
     {
-        size_t BestFlockID = BestBoidFlocks[b].second;
-        Emigrants[BestFlockID].push_back((*Boids[b]));
-        Emigrants[BestFlockID].back().FlockID = BestFlockID;
+        const size_t BestFlockID = BestFlock[b];
+        if (BestFlockID == FlockID)
+            continue; // staying put, nothing to move
+        // local boids are found by their position in our neighbourhood, global ones by BoidID
+        const size_t Idx = (NLayout::GetType() == NLayout::Local) ? b : Boids[b]->BoidID;
+        Emigrants[NumEmigrants++] = std::make_pair(Idx, BestFlockID);
     }
 #ifndef NDEBUG
-    // No boid left behind
-    size_t NumBuckets = 0;
-    for (auto It = Emigrants.begin(); It != Emigrants.end(); It++)
+    // No boid leaves twice
+    assert(NumEmigrants <= Neighbourhood.Size());
+    for (size_t i = 0; i < NumEmigrants; i++)
     {
-        NumBuckets += It->second.size();
-        for (const Boid &B : It->second)
+        assert(Emigrants[i].second != FlockID);
+        assert(i == 0 || Emigrants[i - 1].first < Emigrants[i].first || NLayout::GetType() == NLayout::Global);
+    }
+#endif
+}
+
+void Flock::ReserveImmigrants()
+{
+    /// NOTE: must be done (by all flocks) before any AssignToFlock so that no
+    // neighbourhood reallocates while another flock reads its emigrants out of it
+    assert(IsValidFlock());
+    NumImmigrants = 0;
+    for (size_t n = 0; n < NumNearby; n++)
+    {
+        const Flock *Other = NearbyFlocks[n];
+        for (size_t e = 0; e < Other->NumEmigrants; e++)
         {
-            assert(B.IsValid());
+            if (Other->Emigrants[e].second == FlockID)
+                NumImmigrants++;
         }
     }
-
-    assert(NumBuckets == Neighbourhood.Size());
-#endif
+    Neighbourhood.Reserve(NumImmigrants);
 }
 
 void Flock::AssignToFlock(const int TID)
 {
     assert(IsValidFlock());
     TIDs.AssignToFlock = TID;
-    if (NearbyFlocks.size() > 1) // if this is the last flock, do nothing
+    if (NumImmigrants == 0)
+        return; // nobody is joining us
+    // immigrants can only come from nearby flocks
+    for (size_t n = 0; n < NumNearby; n++)
     {
-        Neighbourhood.ClearLocal(); // clear my local neighbourhood
-        for (const Flock *Other : NearbyFlocks)
+        const Flock *Other = NearbyFlocks[n];
+        // Tracer::AddRead(FlockID, Other.FlockID, Flock::AssignToFlockOp);
+        for (size_t e = 0; e < Other->NumEmigrants; e++)
         {
-            // Tracer::AddRead(FlockID, Other.FlockID, Flock::AssignToFlockOp);
-            // O(1) dictionary accesses
-            if (Other->Emigrants.find(FlockID) != Other->Emigrants.end())
-            {
-                const std::vector<Boid> &Immigrants = Other->Emigrants.at(FlockID);
-                // may require critical section if using Global boids vector
-                Neighbourhood.Append(Immigrants);
-            }
+            if (Other->Emigrants[e].second == FlockID)
+                Neighbourhood.Immigrate(Other->Neighbourhood, Other->Emigrants[e].first);
         }
     }
+}
+
+void Flock::RemoveEmigrants()
+{
+    /// NOTE: must be done (by all flocks) after every AssignToFlock, since the
+    // emigrants are read out of our neighbourhood by their new flocks
+    Neighbourhood.Emigrate(Emigrants, NumEmigrants);
     Valid = (Size() > 0); // need to have at least one boid to be a valid flock
 }
 
@@ -142,19 +283,45 @@ void Flock::ComputeBB()
     if (Size() == 0)
         return;
     assert(IsValidFlock());
-    std::vector<Boid *> Boids = Neighbourhood.GetBoids();
+    const BoidRange Boids = Neighbourhood.GetBoids();
     BoundingBox NewBB(Boids[0]->Position); // initialize to Boids[0]'s position
-    for (const Boid *B : Boids)
+    if (Acted && NumEmigrants == 0)
+    {
+        /// NOTE: none of the boids we had when we acted left, so they are all within
+        // ActBounds already & only our immigrants (which were bounded by their old
+        // flocks) still need to be looked at
+        NewBB.Extend(ActBounds);
+        if (NLayout::GetType() == NLayout::Local)
+        {
+            // (immigrants were appended to our neighbourhood)
+            for (size_t b = Boids.Size() - NumImmigrants; b < Boids.Size(); b++)
+            {
+                NewBB.Extend(Boids[b]->Position);
+            }
+        }
+        else
+        {
+            // (global emigrants are kept by BoidID until the end of the tick)
+            const std::vector<Boid> &AllBoids = *Neighbourhood.GetAllBoidsPtr();
+            for (size_t n = 0; n < NumNearby; n++)
+            {
+                const Flock *Other = NearbyFlocks[n];
+                for (size_t e = 0; e < Other->NumEmigrants; e++)
+                {
+                    if (Other->Emigrants[e].second == FlockID)
+                        NewBB.Extend(AllBoids[Other->Emigrants[e].first].Position);
+                }
+            }
+        }
+    }
+    else
     {
-        if (B->Position[0] < NewBB.TopLeftX)
-            NewBB.TopLeftX = B->Position[0];
-        if (B->Position[0] > NewBB.BottomRightX)
-            NewBB.BottomRightX = B->Position[0];
-        if (B->Position[1] < NewBB.TopLeftY)
-            NewBB.TopLeftY = B->Position[1];
-        if (B->Position[1] > NewBB.BottomRightY)
-            NewBB.BottomRightY = B->Position[1];
+        for (const Boid *B : Boids)
+        {
+            NewBB.Extend(B->Position);
+        }
     }
+    Acted = false;
     // assign new bounding box with most extreme boid positions
     BB = NewBB;
 }
@@ -230,7 +397,7 @@ void Flock::Draw(Image &I) const
     assert(IsValidFlock());
 
     /// TODO: check if can-parallelize?
-    std::vector<Boid *> Boids = Neighbourhood.GetBoids();
+    const BoidRange Boids = Neighbourhood.GetBoids();
     if (GlobalParams.ImageParams.RenderBB)
     {
         I.DrawStrokedRect(BB.TopLeftX, BB.TopLeftY, BB.BottomRightX, BB.BottomRightY);
@@ -241,34 +408,124 @@ void Flock::Draw(Image &I) const
     }
 }
 
-void Flock::CleanUp(std::unordered_map<size_t, Flock> &AllFlocks)
+void Flock::Snapshot(RenderQueue::Frame &F, const size_t Offset, const size_t Idx) const
 {
-    /// NOTE: this can probably be parallelized as well...
-    // remove all empty (invalid) flocks
-    /// TODO: Implement this with 210-style filter for O(logn) span
-    // for vector
-    // auto IsInvalid = [](const Flock &F) { return !F.Valid; };
-    // AllFlocks.erase(std::remove_if(AllFlocks.begin(), AllFlocks.end(), IsInvalid), AllFlocks.end());
+    assert(IsValidFlock());
+    const BoidRange Boids = Neighbourhood.GetBoids();
+    assert(Offset + Boids.Size() <= F.Boids.size());
+    if (GlobalParams.ImageParams.RenderBB)
+    {
+        assert(Idx < F.Boxes.size());
+        F.Boxes[Idx] = {BB.TopLeftX, BB.TopLeftY, BB.BottomRightX, BB.BottomRightY};
+    }
+    for (size_t b = 0; b < Boids.Size(); b++)
+    {
+        const Boid *B = Boids[b];
+        F.Boids[Offset + b] = {B->Position[0], B->Position[1], B->Velocity[0], B->Velocity[1], B->GetColour()};
+    }
+}
 
-    // for unordered_map
-    // graciously retrieved from https://en.cppreference.com/w/cpp/container/unordered_map/erase_if
-    for (auto i = AllFlocks.begin(), last = AllFlocks.end(); i != last;)
+void Flock::FindNearbyFlocks(FlockMap &AllFlocks)
+{
+    /// NOTE: sweep-and-prune along x, once the flocks are sorted by their left edge
+    // a flock can only overlap the ones that start before its (extended) right edge
+    /// WARNING: this must be called by every thread of the tick's parallel region
+    const float Rad = GlobalParams.BoidParams.NeighbourhoodRadius;
+    const size_t N = AllFlocks.Size();
+    Flock **Sorted = nullptr;
+    uint32_t *Keys = nullptr;
+    size_t *Order = nullptr, *Rank = nullptr, *NumForward = nullptr, *NumBackward = nullptr;
+#pragma omp single copyprivate(Sorted, Keys, Order, Rank, NumForward, NumBackward)
+    {
+        Sorted = Arena::Alloc<Flock *>(N);
+        Keys = Arena::Alloc<uint32_t>(N);
+        Order = Arena::Alloc<size_t>(N);
+        Rank = Arena::Alloc<size_t>(N);
+        NumForward = Arena::Alloc<size_t>(N);
+        NumBackward = Arena::Alloc<size_t>(N);
+    } // implicit barrier
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        Keys[i] = Morton::FloatKey(AllFlocks[i].BB.TopLeftX);
+    } // implicit barrier
+    Morton::Sort(Keys, N, Order); // (stable, so ties keep their FlockMap order)
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        Sorted[i] = &AllFlocks[Order[i]];
+        Rank[Order[i]] = i; // (where each flock is in Sorted)
+        NumBackward[i] = 0;
+    } // implicit barrier
+    // count every flock's forward pairs first (& the backward ones it hands out), so
+    // its list can be carved out of the arena at its final size
+#pragma omp for schedule(dynamic, 64)
+    for (size_t i = 0; i < N; i++)
     {
-        if (!(i->second.Valid))
+        const Flock *F = Sorted[i];
+        size_t Count = 1; // always overlaps itself
+        for (size_t j = i + 1; j < N && Sorted[j]->BB.TopLeftX < F->BB.BottomRightX + Rad; j++)
         {
-            i = AllFlocks.erase(i);
+            if (Sorted[j]->BB.IntersectsBB(F->BB, Rad))
+            {
+                Count++;
+#pragma omp atomic
+                NumBackward[j]++; // (Sorted[j] gets this pair too)
+            }
         }
-        else
+        NumForward[i] = Count;
+    } // implicit barrier
+#pragma omp for schedule(static)
+    for (size_t j = 0; j < N; j++)
+    {
+        Flock *F = Sorted[j];
+        F->NumNearby = NumForward[j] + NumBackward[j];
+        F->NearbyFlocks = Arena::Alloc<Flock *>(F->NumNearby);
+        F->NearbyFlocks[0] = F;
+        NumBackward[j] = NumForward[j]; // (now the next free slot)
+    } // implicit barrier
+    // then redo the sweep, handing every pair found to the other flock too
+    /// NOTE: the senders claim their slots (after the receiver's forward pairs) with an
+    // atomic cursor, & then each receiver sorts its backward pairs back into Sorted
+    // order (like a serial pass would give them), all in O(N + pairs)
+#pragma omp for schedule(dynamic, 64)
+    for (size_t i = 0; i < N; i++)
+    {
+        Flock *F = Sorted[i];
+        size_t k = 1;
+        for (size_t j = i + 1; j < N && Sorted[j]->BB.TopLeftX < F->BB.BottomRightX + Rad; j++)
         {
-            ++i;
+            if (Sorted[j]->BB.IntersectsBB(F->BB, Rad))
+            {
+                F->NearbyFlocks[k++] = Sorted[j];
+                size_t Slot;
+#pragma omp atomic capture
+                Slot = NumBackward[j]++;
+                Sorted[j]->NearbyFlocks[Slot] = F;
+            }
         }
-    }
+        assert(k == NumForward[i]);
+    } // implicit barrier
+#pragma omp for schedule(dynamic, 64)
+    for (size_t j = 0; j < N; j++)
+    {
+        Flock **Nearby = Sorted[j]->NearbyFlocks;
+        std::sort(Nearby + NumForward[j], Nearby + Sorted[j]->NumNearby, [&](const Flock *A, const Flock *B) {
+            return Rank[AllFlocks.IndexOf(A)] < Rank[AllFlocks.IndexOf(B)];
+        });
+    } // implicit barrier
+}
+
+void Flock::CleanUp(FlockMap &AllFlocks)
+{
+    // remove all empty (invalid) flocks (with a parallel filter)
+    AllFlocks.RemoveInvalid();
 #ifndef NDEBUG
-    for (auto It = AllFlocks.begin(), Last = AllFlocks.end(); It != Last; It++)
+#pragma omp single
+    for (const Flock &F : AllFlocks)
     {
-        assert(It != AllFlocks.end());
-        const Flock &F = It->second;
         assert(F.IsValidFlock());
+        assert(AllFlocks.Find(F.FlockID) == &F);
     }
 #endif
 }
@@ -4,10 +4,16 @@
 #include "Boid.hpp"          // Boid
 #include "Image.hpp"         // Image (for rendering)
 #include "Neighbourhood.hpp" // Low level neighbourhood (SoA vs AoS)
+#include "RenderQueue.hpp"   // RenderQueue (for asynchronous rendering)
 #include "Vec.hpp"           // Vec2D (for COM)
+#include <algorithm>         // std::min, std::max
+#include <limits>            // std::numeric_limits
 #include <unordered_map>     // std::unordered_map
+#include <utility>           // std::pair
 #include <vector>            // std::vector
 
+class FlockMap; // fwd declaration of the flock container
+
 class Flock
 {
   public:
@@ -52,7 +58,7 @@ class Flock
     {
         int SenseAndPlan, Delegate, AssignToFlock;
     };
-    TIDStruct TIDs;
+    TIDStruct TIDs = {-1, -1, -1};
 
     struct BoundingBox
     {
@@ -77,6 +83,28 @@ class Flock
             BottomRightY = V0[1] + MinSize;
             assert(IsValidBB());
         }
+        static BoundingBox Empty()
+        {
+            // (bounds nothing, so extending it by anything gives just that)
+            BoundingBox B;
+            B.TopLeftX = B.TopLeftY = std::numeric_limits<float>::max();
+            B.BottomRightX = B.BottomRightY = std::numeric_limits<float>::lowest();
+            return B;
+        }
+        void Extend(const Vec2D &V)
+        {
+            TopLeftX = std::min(TopLeftX, V[0]);
+            TopLeftY = std::min(TopLeftY, V[1]);
+            BottomRightX = std::max(BottomRightX, V[0]);
+            BottomRightY = std::max(BottomRightY, V[1]);
+        }
+        void Extend(const BoundingBox &B)
+        {
+            TopLeftX = std::min(TopLeftX, B.TopLeftX);
+            TopLeftY = std::min(TopLeftY, B.TopLeftY);
+            BottomRightX = std::max(BottomRightX, B.BottomRightX);
+            BottomRightY = std::max(BottomRightY, B.BottomRightY);
+        }
         Vec2D Centroid() const
         {
             const float W = BottomRightX - TopLeftX;
@@ -114,32 +142,63 @@ class Flock
         // see https://stackoverflow.com/questions/401847/circle-rectangle-collision-detection-intersection
     };
     BoundingBox BB;
+    // where our boids ended up in our last Act (which saves ComputeBB rereading them)
+    BoundingBox ActBounds;
+    bool Acted = false;
 
     bool Valid;
     static FlockParamsStruct Params;
     NLayout Neighbourhood;
-    std::unordered_map<size_t, std::vector<Boid>> Emigrants; // buckets where the delegates go
-    std::vector<Flock *> NearbyFlocks;
+    // (index in our neighbourhood, destination FlockID) of every boid leaving this tick
+    // (from the Delegating thread's arena, so only valid until the end of the tick)
+    std::pair<size_t, size_t> *Emigrants = nullptr;
+    size_t NumEmigrants = 0;
+    size_t NumImmigrants = 0;
+    // flocks whose BB overlaps ours (incl. ourselves), from the tick's arena
+    Flock **NearbyFlocks = nullptr;
+    size_t NumNearby = 0;
+    size_t Interactions = 0;           // boids sensed by our boids in the last SenseAndPlan
+    int HomeTID = -1;                  // thread the scheduler keeps us on (with affinity)
 
     bool IsValidFlock() const;
 
     size_t Size() const;
 
-    void SenseAndPlan(const int TID, const std::unordered_map<size_t, Flock> &AllFlocks);
+    void SenseAndPlan(const int TID, const FlockMap &AllFlocks);
+    // only the boids in [Begin, End) of our neighbourhood, returns how many boids they sensed
+    size_t SenseAndPlan(const int TID, const FlockMap &AllFlocks, const size_t Begin, const size_t End);
 
     void Act(const float DeltaTime);
+    // (returns the bounds of where those boids moved to)
+    BoundingBox Act(const float DeltaTime, const size_t Begin, const size_t End);
+
+    // SenseAndPlan & Act in a single pass (only with double buffered state)
+    void SenseAndAct(const int TID, const FlockMap &AllFlocks, const float DeltaTime);
+    BoundingBox SenseAndAct(const int TID, const FlockMap &AllFlocks, const float DeltaTime, const size_t Begin,
+                            const size_t End, size_t &NumSensed);
+
+    void Delegate(const int TID);
 
-    void Delegate(const int TID, const std::vector<Flock *> &AllFlocks);
+    void ReserveImmigrants();
 
     void AssignToFlock(const int TID);
 
+    void RemoveEmigrants();
+
     void ComputeBB();
 
     std::vector<Flock *> NearestFlocks(const std::vector<Flock *> &AllFlocks) const;
 
     void Draw(Image &I) const;
+    // copy what Draw needs into F (our boids at Offset, our bounding box at Idx)
+    void Snapshot(RenderQueue::Frame &F, const size_t Offset, const size_t Idx) const;
+
+    // broad phase, fills in every flock's NearbyFlocks once per tick
+    // (called by every thread of the tick's parallel region)
+    static void FindNearbyFlocks(FlockMap &AllFlocks);
 
-    static void CleanUp(std::unordered_map<size_t, Flock> &AllFlocks);
+    // (called by every thread of the tick's parallel region)
+    static void CleanUp(FlockMap &AllFlocks);
 
     void Destroy();
 };
@@ -0,0 +1,111 @@
+#include "FlockMap.hpp"
+#include "Arena.hpp" // per-thread counts
+#include <algorithm> // std::min
+#include <cassert>
+#include <omp.h> // OpenMP
+
+// declaring static variables
+const size_t FlockMap::Dead;
+
+FlockMap::Handle FlockMap::Insert(Flock &&F)
+{
+    const size_t FlockID = F.FlockID;
+    if (FlockID >= Slots.size())
+    {
+        Slots.resize(FlockID + 1, Dead);
+        Generations.resize(FlockID + 1, 0);
+    }
+    assert(Slots[FlockID] == Dead); // FlockIDs are unique
+    Slots[FlockID] = Flocks.size();
+    Flocks.push_back(std::move(F));
+    return GetHandle(FlockID);
+}
+
+void FlockMap::Reserve(const size_t NumFlocks)
+{
+    Flocks.reserve(NumFlocks);
+    Slots.reserve(NumFlocks);
+    Generations.reserve(NumFlocks);
+}
+
+Flock *FlockMap::Find(const size_t FlockID) const
+{
+    if (FlockID >= Slots.size() || Slots[FlockID] == Dead)
+        return nullptr;
+    assert(Flocks[Slots[FlockID]].FlockID == FlockID);
+    /// NOTE: using const-cast to keep function marked const
+    return const_cast<Flock *>(&Flocks[Slots[FlockID]]);
+}
+
+Flock *FlockMap::Find(const Handle &H) const
+{
+    if (H.FlockID >= Generations.size() || Generations[H.FlockID] != H.Generation)
+        return nullptr; // stale handle
+    return Find(H.FlockID);
+}
+
+FlockMap::Handle FlockMap::GetHandle(const size_t FlockID) const
+{
+    assert(FlockID < Generations.size());
+    return {FlockID, Generations[FlockID]};
+}
+
+void FlockMap::RemoveInvalid()
+{
+    /// NOTE: a (stable) parallel filter, every thread counts the live flocks in its own
+    // chunk, a prefix sum over the counts gives where each chunk's live flocks go, then
+    // every thread moves its live flocks there (into Scratch, so no move overlaps)
+    /// WARNING: this must be called by every thread of the tick's parallel region
+    const size_t N = Flocks.size();
+    const size_t NumThreads = omp_get_num_threads();
+    const size_t TID = omp_get_thread_num();
+    const size_t Chunk = (N + NumThreads - 1) / NumThreads;
+    const size_t Begin = std::min(N, TID * Chunk);
+    const size_t End = std::min(N, Begin + Chunk);
+    size_t *Offsets = nullptr;
+#pragma omp single copyprivate(Offsets)
+    Offsets = Arena::Alloc<size_t>(NumThreads + 1); // (implicit barrier)
+    size_t NumLive = 0;
+    for (size_t i = Begin; i < End; i++)
+    {
+        if (Flocks[i].Valid)
+            NumLive++;
+    }
+    Offsets[TID + 1] = NumLive;
+#pragma omp barrier
+#pragma omp single
+    {
+        Offsets[0] = 0;
+        for (size_t t = 0; t < NumThreads; t++)
+        {
+            Offsets[t + 1] += Offsets[t]; // prefix sum
+        }
+        /// NOTE: flocks are never created after the first tick, so this only
+        // default-constructs flocks once (after that Scratch holds the last tick's shells)
+        if (Offsets[NumThreads] < N && Scratch.size() < Offsets[NumThreads])
+            Scratch.resize(Offsets[NumThreads]);
+    } // implicit barrier
+    if (Offsets[NumThreads] == N)
+        return; // no flock died (the common case once they have all merged)
+    size_t Next = Offsets[TID];
+    for (size_t i = Begin; i < End; i++)
+    {
+        const size_t FlockID = Flocks[i].FlockID;
+        if (!Flocks[i].Valid)
+        {
+            Slots[FlockID] = Dead;
+            Generations[FlockID]++;
+            continue;
+        }
+        Scratch[Next] = std::move(Flocks[i]);
+        Slots[FlockID] = Next;
+        Next++;
+    }
+    assert(Next == Offsets[TID + 1]);
+#pragma omp barrier
+#pragma omp single
+    {
+        Flocks.swap(Scratch);
+        Flocks.resize(Offsets[NumThreads]); // (only drops moved-from shells)
+    } // implicit barrier
+}
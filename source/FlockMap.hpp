@@ -0,0 +1,72 @@
+#ifndef FLOCKMAP
+#define FLOCKMAP
+
+#include "Flock.hpp" // Flock
+#include <vector>    // std::vector
+
+class FlockMap // slot map of all the live flocks, stored contiguously
+{
+  public:
+    struct Handle // refers to one flock for as long as it is alive
+    {
+        size_t FlockID, Generation;
+    };
+    // add a new flock (stored at F.FlockID), must be done before any lookups
+    Handle Insert(Flock &&F);
+    void Reserve(const size_t NumFlocks);
+    // O(1) lookups, return nullptr if the flock has been removed
+    Flock *Find(const size_t FlockID) const;
+    Flock *Find(const Handle &H) const;
+    Handle GetHandle(const size_t FlockID) const;
+    // remove all empty (invalid) flocks, keeping the live ones in order
+    // (called by every thread of the tick's parallel region)
+    void RemoveInvalid();
+    // contiguous access to the live flocks
+    size_t Size() const
+    {
+        return Flocks.size();
+    }
+    Flock &operator[](const size_t Idx)
+    {
+        assert(Idx < Flocks.size());
+        return Flocks[Idx];
+    }
+    const Flock &operator[](const size_t Idx) const
+    {
+        assert(Idx < Flocks.size());
+        return Flocks[Idx];
+    }
+    // inverse of operator[] (for a live flock)
+    size_t IndexOf(const Flock *F) const
+    {
+        assert(F >= Flocks.data() && F < Flocks.data() + Flocks.size());
+        return F - Flocks.data();
+    }
+    std::vector<Flock>::iterator begin()
+    {
+        return Flocks.begin();
+    }
+    std::vector<Flock>::iterator end()
+    {
+        return Flocks.end();
+    }
+    std::vector<Flock>::const_iterator begin() const
+    {
+        return Flocks.begin();
+    }
+    std::vector<Flock>::const_iterator end() const
+    {
+        return Flocks.end();
+    }
+
+  private:
+    static const size_t Dead = ~size_t(0);
+    /// NOTE: FlockIDs are stable (the tracer indexes its matrix by them) and never
+    // reused, so the slot of a FlockID is just its index into Slots & Generations
+    std::vector<Flock> Flocks;       // the live flocks
+    std::vector<Flock> Scratch;      // (moved-from flocks, filtered into on removal)
+    std::vector<size_t> Slots;       // FlockID -> index into Flocks (or Dead)
+    std::vector<size_t> Generations; // FlockID -> bumped every time the flock dies
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "Grid.hpp"
+#include "Arena.hpp" // scratch buffers
+#include <algorithm> // std::min, std::max
+#include <cmath>     // std::ceil, std::floor
+#include <omp.h>     // OpenMP
+
+// declaring static variables
+float SpatialGrid::CellSize;
+size_t SpatialGrid::NumCellsX;
+size_t SpatialGrid::NumCellsY;
+std::vector<size_t> SpatialGrid::CellStart;
+BoidSoA SpatialGrid::Cells;
+std::vector<size_t> SpatialGrid::BoidCells;
+bool SpatialGrid::Binned = false;
+
+void SpatialGrid::Init()
+{
+    /// NOTE: the grid is also used to build the verlet lists, so always initialize it
+    CellSize = GlobalParams.BoidParams.NeighbourhoodRadius;
+    assert(CellSize > 0);
+    // boids that wander outside the window are clamped into the border cells
+    NumCellsX = std::max(size_t(1), size_t(std::ceil(GlobalParams.ImageParams.WindowX / CellSize)));
+    NumCellsY = std::max(size_t(1), size_t(std::ceil(GlobalParams.ImageParams.WindowY / CellSize)));
+    CellStart = std::vector<size_t>(NumCellsX * NumCellsY + 1, 0);
+    BoidCells.clear();
+    Binned = false;
+}
+
+bool SpatialGrid::IsEnabled()
+{
+    return GlobalParams.FlockParams.UseSpatialGrid;
+}
+
+void SpatialGrid::CellCoords(const Vec2D &Pos, size_t &X, size_t &Y)
+{
+    /// NOTE: clamping keeps the 3x3 search correct, since two points within
+    // CellSize of each other are still at most one (clamped) cell apart
+    const float MaxX = NumCellsX - 1;
+    const float MaxY = NumCellsY - 1;
+    X = size_t(std::min(std::max(std::floor(Pos[0] / CellSize), 0.f), MaxX));
+    Y = size_t(std::min(std::max(std::floor(Pos[1] / CellSize), 0.f), MaxY));
+}
+
+size_t SpatialGrid::NumRings(const float Radius)
+{
+    return std::max(size_t(1), size_t(std::ceil(Radius / CellSize)));
+}
+
+size_t SpatialGrid::CellIdx(const size_t X, const size_t Y)
+{
+    assert(X < NumCellsX && Y < NumCellsY);
+    return X + Y * NumCellsX;
+}
+
+size_t SpatialGrid::CellBegin(const size_t Cell)
+{
+    assert(Cell < CellStart.size() - 1);
+    return CellStart[Cell];
+}
+
+size_t SpatialGrid::CellEnd(const size_t Cell)
+{
+    assert(Cell < CellStart.size() - 1);
+    return CellStart[Cell + 1];
+}
+
+const BoidSoA &SpatialGrid::GetCells()
+{
+    return Cells;
+}
+
+bool SpatialGrid::CanBin()
+{
+    return !BoidCells.empty(); // (only once the grid has been built)
+}
+
+void SpatialGrid::Bin(const size_t BoidID, const Vec2D &Pos)
+{
+    assert(BoidID < BoidCells.size());
+    size_t X, Y;
+    CellCoords(Pos, X, Y);
+    BoidCells[BoidID] = CellIdx(X, Y);
+}
+
+void SpatialGrid::SetBinned(const bool AllBinned)
+{
+    Binned = AllBinned && CanBin();
+}
+
+void SpatialGrid::Rebuild()
+{
+    /// NOTE: this must be rebuilt every tick (before anyone senses) since the grid
+    // holds a snapshot of the boids' positions and velocities
+    /// WARNING: this must be called by every thread of the tick's parallel region
+    const BoidSoA &AllBoids = NLayout::GetSoA();
+    const size_t NumBoids = AllBoids.Size();
+    /// WARNING: read before the barrier below, since the counting sort resets it
+    const bool WasBinned = Binned && BoidCells.size() == NumBoids;
+#pragma omp single
+    {
+        BoidCells.resize(NumBoids);
+        Cells.Resize(NumBoids);
+    } // implicit barrier
+
+    // counting sort of all the boids by their cell (which Flock::Act usually found)
+    if (!WasBinned)
+    {
+#pragma omp for schedule(static)
+        for (size_t i = 0; i < NumBoids; i++)
+        {
+            size_t X, Y;
+            CellCoords(Vec2D(AllBoids.X[i], AllBoids.Y[i]), X, Y);
+            BoidCells[i] = CellIdx(X, Y);
+        } // implicit barrier
+    }
+    /// NOTE: every thread counts (then scatters) its own contiguous chunk of the boids
+    // into per-thread histograms, like Morton::Sort's passes, & the prefix sum over the
+    // (cell, thread) counts is split by cells across the threads too
+    const size_t NumCells = NumCellsX * NumCellsY;
+    const size_t NumThreads = omp_get_num_threads();
+    const size_t TID = omp_get_thread_num();
+    size_t *Counts = nullptr, *Totals = nullptr;
+#pragma omp single copyprivate(Counts, Totals)
+    {
+        Binned = false; // (BoidCells becomes where each boid goes)
+        Counts = Arena::Alloc<size_t>(NumThreads * NumCells);
+        Totals = Arena::Alloc<size_t>(NumThreads + 1);
+    } // implicit barrier
+    const size_t Chunk = (NumBoids + NumThreads - 1) / NumThreads;
+    const size_t Begin = std::min(NumBoids, TID * Chunk);
+    const size_t End = std::min(NumBoids, Begin + Chunk);
+    const size_t CellChunk = (NumCells + NumThreads - 1) / NumThreads;
+    const size_t CellBegin = std::min(NumCells, TID * CellChunk);
+    const size_t CellEnd = std::min(NumCells, CellBegin + CellChunk);
+    size_t *MyCounts = &Counts[TID * NumCells];
+    std::fill(MyCounts, MyCounts + NumCells, 0);
+    for (size_t i = Begin; i < End; i++)
+    {
+        MyCounts[BoidCells[i]]++; // histogram
+    }
+#pragma omp barrier
+    size_t Sum = 0;
+    for (size_t c = CellBegin; c < CellEnd; c++)
+    {
+        for (size_t t = 0; t < NumThreads; t++)
+        {
+            Sum += Counts[t * NumCells + c];
+        }
+    }
+    Totals[TID + 1] = Sum;
+#pragma omp barrier
+#pragma omp single
+    {
+        Totals[0] = 0;
+        for (size_t t = 0; t < NumThreads; t++)
+        {
+            Totals[t + 1] += Totals[t]; // prefix sum (of each thread's cells)
+        }
+        CellStart[NumCells] = NumBoids;
+    } // implicit barrier
+    // exclusive prefix sum in (cell, thread) order keeps the sort stable
+    size_t Next = Totals[TID];
+    for (size_t c = CellBegin; c < CellEnd; c++)
+    {
+        CellStart[c] = Next;
+        for (size_t t = 0; t < NumThreads; t++)
+        {
+            const size_t C = Counts[t * NumCells + c];
+            Counts[t * NumCells + c] = Next;
+            Next += C;
+        }
+    }
+#pragma omp barrier
+    // scatter into place, where BoidCells becomes the index of each boid in Cells
+    for (size_t i = Begin; i < End; i++)
+    {
+        BoidCells[i] = MyCounts[BoidCells[i]]++;
+        Cells.Copy(BoidCells[i], AllBoids, i);
+    }
+#pragma omp barrier
+    assert(CellStart.back() == NumBoids);
+}
@@ -0,0 +1,62 @@
+#ifndef GRID
+#define GRID
+
+#include "Neighbourhood.hpp" // BoidSoA
+#include "Utils.hpp"         // Params
+#include "Vec.hpp"           // Vec2D
+#include <algorithm>         // std::min
+#include <vector>            // std::vector
+
+class SpatialGrid // uniform grid (cell list) over the world for neighbour queries
+{
+  public:
+    static void Init();
+    static bool IsEnabled();
+    // (called by every thread of the tick's parallel region)
+    static void Rebuild();
+    static void CellCoords(const Vec2D &Pos, size_t &X, size_t &Y);
+    static size_t CellIdx(const size_t X, const size_t Y);
+    // range of (cell-sorted) boids within one cell
+    static size_t CellBegin(const size_t Cell);
+    static size_t CellEnd(const size_t Cell);
+    static const BoidSoA &GetCells();
+    // (with the grid in use) record the cell of a boid that just moved (by BoidID), so
+    // the next rebuild can skip finding them, as long as every boid was binned
+    static bool CanBin();
+    static void Bin(const size_t BoidID, const Vec2D &Pos);
+    static void SetBinned(const bool AllBinned);
+    // cell coordinates
+    static size_t NumCellsX, NumCellsY;
+    // how many rings of cells around a boid cover a search radius
+    static size_t NumRings(const float Radius);
+
+    template <typename RowFn> static void ForEachRow(const Vec2D &Pos, const size_t Rings, RowFn Fn)
+    {
+        // calls Fn(Begin, End) for the (contiguous) boids of each row of cells
+        // within Rings cells of Pos
+        size_t CX, CY;
+        CellCoords(Pos, CX, CY);
+        const size_t MinX = (CX > Rings) ? CX - Rings : 0;
+        const size_t MinY = (CY > Rings) ? CY - Rings : 0;
+        const size_t MaxX = std::min(CX + Rings, NumCellsX - 1);
+        const size_t MaxY = std::min(CY + Rings, NumCellsY - 1);
+        for (size_t Y = MinY; Y <= MaxY; Y++)
+        {
+            Fn(CellBegin(CellIdx(MinX, Y)), CellEnd(CellIdx(MaxX, Y)));
+        }
+    }
+
+  private:
+    // cells are (at least) neighbourhood_radius wide so all neighbours of a
+    // boid lie within the 3x3 block of cells around it
+    static float CellSize;
+    // CellStart[c] is the first index of cell c in Cells (CSR style)
+    static std::vector<size_t> CellStart;
+    // (a copy of) the hot state of every boid in the world, sorted by cell
+    static BoidSoA Cells;
+    // the cell of every boid (by BoidID), then scratch space for the counting sort
+    static std::vector<size_t> BoidCells;
+    static bool Binned; // (BoidCells holds the cells of where the boids are now)
+};
+
+#endif
\ No newline at end of file
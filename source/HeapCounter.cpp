@@ -0,0 +1,30 @@
+#include "HeapCounter.hpp"
+#include <algorithm> // std::max
+#include <cstdlib>   // std::malloc, std::free
+#include <new>       // std::bad_alloc
+
+/// NOTE: replacing the global operator new/delete lets us count every heap
+// allocation the simulator makes (through std containers or otherwise)
+void *operator new(std::size_t Bytes)
+{
+    HeapCounter::Count();
+    void *Ptr = std::malloc(std::max(Bytes, std::size_t(1)));
+    if (Ptr == nullptr)
+        throw std::bad_alloc();
+    return Ptr;
+}
+
+void *operator new[](std::size_t Bytes)
+{
+    return operator new(Bytes);
+}
+
+void operator delete(void *Ptr) noexcept
+{
+    std::free(Ptr);
+}
+
+void operator delete[](void *Ptr) noexcept
+{
+    std::free(Ptr);
+}
@@ -0,0 +1,31 @@
+#ifndef HEAPCOUNTER
+#define HEAPCOUNTER
+
+#include <atomic>  // std::atomic
+#include <cstddef> // size_t
+
+class HeapCounter // counts the heap allocations of the (shared memory) Simulator
+{
+  public:
+    /// NOTE: the allocations through operator new are counted by its replacement in
+    // HeapCounter.cpp, which is only linked into the Simulator (the other binaries keep
+    // the default allocator), everything that calls malloc & co. directly counts itself
+    static void Count()
+    {
+        Allocs().fetch_add(1, std::memory_order_relaxed);
+    }
+    // number of heap allocations since the program started
+    static size_t NumAllocs()
+    {
+        return Allocs().load(std::memory_order_relaxed);
+    }
+
+  private:
+    static std::atomic<size_t> &Allocs()
+    {
+        static std::atomic<size_t> N(0); // (one for the whole program, as Allocs is inline)
+        return N;
+    }
+};
+
+#endif
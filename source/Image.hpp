@@ -2,7 +2,8 @@
 #define IMAGE_H
 
 #include "Vec.hpp"
-#include <cmath> // pow
+#include <algorithm> // std::fill
+#include <cmath>     // pow
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -54,6 +55,18 @@ class Image
         Data = std::vector<Colour>(Params.WindowX * Params.WindowY);
     }
 
+    struct Clip // only pixels in [X0, X1) x [Y0, Y1) are drawn (eg. one screen tile)
+    {
+        Clip() : X0(0), Y0(0), X1(~size_t(0)), Y1(~size_t(0)) // (everything)
+        {
+        }
+        size_t X0, Y0, X1, Y1;
+        bool Contains(const size_t X, const size_t Y) const
+        {
+            return X >= X0 && X < X1 && Y >= Y0 && Y < Y1;
+        }
+    };
+
     static ImageParamsStruct Params;
     std::vector<Colour> Data;
     size_t NumExported = 0;
@@ -80,6 +93,12 @@ class Image
         SetPixel(Pos[0], Pos[1], C);
     }
 
+    void SetPixel(const size_t X, const size_t Y, const Colour &C, const Clip &R)
+    {
+        if (R.Contains(X, Y))
+            SetPixel(X, Y, C);
+    }
+
     void SetPixelW(const float X, const float Y, const Colour &C) // sets pixel with wrapping
     {
         const float MaxW = Params.WindowX - 1;
@@ -108,25 +127,23 @@ class Image
 
     void Blank()
     {
-        const size_t BorderSize = 0;
-        for (size_t i = 0; i < Params.WindowX; i++)
+        Blank(Clip());
+    }
+
+    void Blank(const Clip &R)
+    {
+        /// NOTE: clears whole rows (of the clip) at a time, which compiles down to a
+        // vectorized fill (rather than a bounds-checked store per pixel)
+        const size_t X0 = std::min(R.X0, Params.WindowX), X1 = std::min(R.X1, Params.WindowX);
+        const size_t Y0 = std::min(R.Y0, Params.WindowY), Y1 = std::min(R.Y1, Params.WindowY);
+        for (size_t j = Y0; j < Y1; j++)
         {
-            for (size_t j = 0; j < Params.WindowY; j++)
-            {
-                if (int(i) < int(BorderSize) || i > Params.WindowX - BorderSize || int(j) < int(BorderSize) ||
-                    j > Params.WindowY - BorderSize)
-                {
-                    SetPixel(i, j, Colour(255, 255, 255));
-                }
-                else
-                {
-                    SetPixel(i, j, Colour(0, 0, 0));
-                }
-            }
+            Colour *Row = Data.data() + j * Params.WindowX;
+            std::fill(Row + X0, Row + X1, Colour(0, 0, 0));
         }
     }
 
-    void DrawSolidCircle(const Vec2D &Center, const size_t Radius, const Colour &C)
+    void DrawSolidCircle(const Vec2D &Center, const size_t Radius, const Colour &C, const Clip &R = Clip())
     {
         const float X = Center[0];
         const float Y = Center[1];
@@ -136,7 +153,7 @@ class Image
             {
                 if (sqr(pX - X) + sqr(pY - Y) < sqr(Radius))
                 {
-                    SetPixel(pX, pY, C);
+                    SetPixel(pX, pY, C, R);
                 }
             }
         }
@@ -203,15 +220,35 @@ class Image
         }
     }
 
-    void DrawLine(const Vec2D &A, const Vec2D &B, const Colour &C)
+    void DrawLine(const Vec2D &A, const Vec2D &B, const Colour &C, const Clip &R = Clip())
     {
         Vec2D Direction = B - A;
         const float Magnitude = Direction.Size();
+        if (!(Magnitude > 0))
+            return; // (nothing to step along)
         Direction /= Magnitude; // normalize it
-        for (size_t i = 0; i < Magnitude; i++)
+        // only step along the part of the line that can land in the clip
+        float Begin = 0, End = Magnitude;
+        for (size_t d = 0; d < 2; d++)
+        {
+            // (pixels are truncated, so [Lo - 1, Hi + 1] holds every point that lands in it)
+            const float Lo = (d == 0 ? R.X0 : R.Y0) - 1.f, Hi = (d == 0 ? float(R.X1) : float(R.Y1)) + 1.f;
+            if (Direction[d] == 0)
+            {
+                if (A[d] < Lo || A[d] > Hi)
+                    return;
+                continue;
+            }
+            const float T0 = (Lo - A[d]) / Direction[d], T1 = (Hi - A[d]) / Direction[d];
+            Begin = std::max(Begin, std::min(T0, T1));
+            End = std::min(End, std::max(T0, T1));
+        }
+        if (Begin > End)
+            return;
+        for (size_t i = std::floor(Begin); i < Magnitude && i <= End + 1; i++)
         {
             const Vec2D Pixel = A + Direction * i;
-            SetPixel(Pixel, C);
+            SetPixel(Pixel[0], Pixel[1], C, R);
         }
     }
 
@@ -229,13 +266,18 @@ class Image
 
     void ExportPPMImage()
     {
-        if (NumExported > MaxFrames)
+        ExportPPMImage(NumExported);
+    }
+
+    void ExportPPMImage(const size_t Frame)
+    {
+        if (Frame > MaxFrames)
         {
             std::cout << "Cannot export more than " << MaxFrames << " frames! " << std::endl;
             return;
         }
         std::string Path = "out/";
-        std::string NumStr = std::to_string(NumExported); // which frame this is
+        std::string NumStr = std::to_string(Frame); // which frame this is
         std::string Filename = Path + std::string(NumLeading0s - NumStr.length(), '0') + NumStr + ".ppm";
 
         // Begin writing output stream
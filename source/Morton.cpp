@@ -0,0 +1,101 @@
+#include "Morton.hpp"
+#include "Arena.hpp" // scratch buffers
+#include <algorithm> // std::min, std::max
+#include <cassert>
+#include <cstring>   // std::memcpy
+#include <omp.h>     // OpenMP
+
+uint32_t Morton::SpreadBits(uint32_t V)
+{
+    // spread the lower 16 bits out into the even bits
+    V &= 0x0000FFFF;
+    V = (V | (V << 8)) & 0x00FF00FF;
+    V = (V | (V << 4)) & 0x0F0F0F0F;
+    V = (V | (V << 2)) & 0x33333333;
+    V = (V | (V << 1)) & 0x55555555;
+    return V;
+}
+
+uint32_t Morton::Encode(const float X, const float Y)
+{
+    // quantize to 16 bits per axis (boids outside the window are clamped to its edge)
+    const float MaxQ = 65535.f;
+    const float QX = std::min(std::max(X / GlobalParams.ImageParams.WindowX, 0.f), 1.f) * MaxQ;
+    const float QY = std::min(std::max(Y / GlobalParams.ImageParams.WindowY, 0.f), 1.f) * MaxQ;
+    return SpreadBits(uint32_t(QX)) | (SpreadBits(uint32_t(QY)) << 1);
+}
+
+uint32_t Morton::FloatKey(const float X)
+{
+    // setting the sign bit of positive floats (& flipping every bit of negative ones)
+    // orders their bit patterns like the floats themselves, without losing precision
+    uint32_t Bits;
+    std::memcpy(&Bits, &X, sizeof(Bits));
+    return (Bits & 0x80000000u) ? ~Bits : (Bits | 0x80000000u);
+}
+
+void Morton::Sort(const uint32_t *Keys, const size_t N, size_t *Order)
+{
+    /// NOTE: 4 stable passes of 8 bits each, where each thread counts (then scatters)
+    // its own contiguous chunk of the keys
+    /// WARNING: this must be called by every thread of the tick's parallel region
+    const size_t Radix = 256;
+    const size_t NumThreads = omp_get_num_threads();
+    const size_t TID = omp_get_thread_num();
+    // the passes ping-pong between Order & TmpIdxs, so (after an even number) the
+    // sorted indices end up in Order
+    size_t *Idxs = Order;
+    size_t *TmpIdxs = nullptr, *Counts = nullptr;
+    uint32_t *SortedKeys = nullptr, *TmpKeys = nullptr;
+#pragma omp single copyprivate(TmpIdxs, Counts, SortedKeys, TmpKeys)
+    {
+        TmpIdxs = Arena::Alloc<size_t>(N);
+        Counts = Arena::Alloc<size_t>(NumThreads * Radix);
+        SortedKeys = Arena::Alloc<uint32_t>(N);
+        TmpKeys = Arena::Alloc<uint32_t>(N);
+    } // implicit barrier
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        Idxs[i] = i;
+        SortedKeys[i] = Keys[i];
+    } // implicit barrier
+    const size_t Chunk = (N + NumThreads - 1) / NumThreads;
+    const size_t Begin = std::min(N, TID * Chunk);
+    const size_t End = std::min(N, Begin + Chunk);
+    size_t *MyCounts = &Counts[TID * Radix];
+    for (size_t Shift = 0; Shift < 32; Shift += 8)
+    {
+        std::fill(MyCounts, MyCounts + Radix, 0);
+        for (size_t i = Begin; i < End; i++)
+        {
+            MyCounts[(SortedKeys[i] >> Shift) & (Radix - 1)]++;
+        }
+#pragma omp barrier
+#pragma omp single
+        {
+            // exclusive prefix sum in (digit, thread) order keeps the sort stable
+            size_t Sum = 0;
+            for (size_t d = 0; d < Radix; d++)
+            {
+                for (size_t t = 0; t < NumThreads; t++)
+                {
+                    const size_t C = Counts[t * Radix + d];
+                    Counts[t * Radix + d] = Sum;
+                    Sum += C;
+                }
+            }
+        } // implicit barrier
+        for (size_t i = Begin; i < End; i++)
+        {
+            const size_t Dst = MyCounts[(SortedKeys[i] >> Shift) & (Radix - 1)]++;
+            TmpKeys[Dst] = SortedKeys[i];
+            TmpIdxs[Dst] = Idxs[i];
+        }
+        // (every thread swaps its own copies of the pointers)
+        std::swap(SortedKeys, TmpKeys);
+        std::swap(Idxs, TmpIdxs);
+#pragma omp barrier
+    }
+    assert(Idxs == Order);
+}
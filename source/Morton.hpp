@@ -0,0 +1,23 @@
+#ifndef MORTON
+#define MORTON
+
+#include "Utils.hpp" // Params
+#include <cstdint>   // uint32_t
+
+class Morton // Z-order curve over the world (for spatially sorting boids)
+{
+  public:
+    // interleaves the (quantized) x & y of a point in the world
+    static uint32_t Encode(const float X, const float Y);
+    // a key that sorts (unsigned) like X does (for sorting by one coordinate)
+    static uint32_t FloatKey(const float X);
+    // parallel (LSD) radix sort, Order[k] is the index of the k'th smallest key
+    // (Order must have space for N indices, scratch space comes from the tick arena,
+    // called by every thread of the tick's parallel region)
+    static void Sort(const uint32_t *Keys, const size_t N, size_t *Order);
+
+  private:
+    static uint32_t SpreadBits(uint32_t V);
+};
+
+#endif
\ No newline at end of file
@@ -1,13 +1,22 @@
 #include "Neighbourhood.hpp"
+#include "Arena.hpp"
+#include "Morton.hpp"
 #include "Vec.hpp"
+#include <algorithm>
 #include <omp.h>
 
 // default layout is invalid until assigned
 NLayout::Layout NLayout::UsingLayout = NLayout::Invalid;
 // boid struct of arrays is empty
 std::vector<Boid> NLayout::BoidsGlobal;
+std::vector<Boid> NLayout::BoidsGlobalScratch;
 // boid sizes hash map is empty
-std::unordered_map<size_t, NLayout::FlockData> NLayout::BoidsGlobalData;
+std::vector<size_t> NLayout::GlobalMembers;
+std::vector<size_t> NLayout::FlockStart;
+// hot boid state is empty
+BoidSoA NLayout::BoidsSoA;
+BoidSoA NLayout::BoidsSoAScratch;
+BoidSoA NLayout::BoidsSoANext;
 
 void NLayout::SetType(const Layout L)
 {
@@ -22,6 +31,159 @@ NLayout::Layout NLayout::GetType()
     return UsingLayout;
 }
 
+const BoidSoA &NLayout::GetSoA()
+{
+    return BoidsSoA;
+}
+
+void NLayout::StoreSoA(const Boid &B)
+{
+    /// NOTE: this is thread safe as long as no two threads write the same boid
+    BoidsSoA.Store(B.BoidID, B);
+}
+
+bool NLayout::IsDoubleBuffered()
+{
+    return GlobalParams.BoidParams.DoubleBuffer;
+}
+
+void NLayout::StoreNextSoA(const Boid &B)
+{
+    /// NOTE: FlockIDs & BoidIDs only change outside of the boids' updates, so they
+    // are not double buffered (and immigration writes them in place)
+    assert(IsDoubleBuffered());
+    BoidsSoANext.StoreState(B.BoidID, B);
+}
+
+void NLayout::SwapSoA()
+{
+    /// WARNING: every boid must have stored its next state, since whatever was not
+    // overwritten is two ticks old
+    assert(IsDoubleBuffered() && BoidsSoANext.Size() == BoidsSoA.Size());
+    BoidsSoA.SwapState(BoidsSoANext);
+}
+
+void NLayout::Reorder()
+{
+    /// WARNING: this function must be called outside of all other flock operations
+    // since it moves (and renumbers) every boid in BoidsGlobal (and by every thread
+    // of the tick's parallel region)
+    assert(UsingLayout == Global);
+    const size_t N = BoidsGlobal.size();
+    uint32_t *Keys = nullptr;
+    size_t *Order = nullptr; // Order[New] = Old
+#pragma omp single copyprivate(Keys, Order)
+    {
+        Keys = Arena::Alloc<uint32_t>(N);
+        Order = Arena::Alloc<size_t>(N);
+        BoidsGlobalScratch.resize(N);
+        BoidsSoAScratch.Resize(N);
+    } // implicit barrier
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        Keys[i] = Morton::Encode(BoidsSoA.X[i], BoidsSoA.Y[i]);
+    } // implicit barrier
+    Morton::Sort(Keys, N, Order);
+
+    // permute both the boids and their hot state (BoidID is always the new index)
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        BoidsGlobalScratch[i] = BoidsGlobal[Order[i]];
+        BoidsGlobalScratch[i].BoidID = i;
+        BoidsSoAScratch.Store(i, BoidsGlobalScratch[i]);
+    } // implicit barrier
+#pragma omp single
+    {
+        BoidsGlobal.swap(BoidsGlobalScratch);
+        std::swap(BoidsSoA, BoidsSoAScratch);
+    } // implicit barrier
+
+    // remap all the per-flock BoidIDs
+    RebuildMembership();
+}
+
+void NLayout::BeginFirstTouch()
+{
+    /// NOTE: every boid was created (so its pages first touched) by the main thread,
+    // which puts all of them on its node. Copying into fresh (untouched) arrays from the
+    // threads that sense each flock puts every flock's lines on its own thread's node
+    /// WARNING: the Boid structs are left as is, they are only used by cold paths
+    const size_t N = BoidsSoA.Size();
+#pragma omp single
+    {
+        BoidsSoAScratch = BoidSoA(); // (so none of its pages are reused)
+        BoidsSoAScratch.Resize(N);
+        if (IsDoubleBuffered())
+        {
+            BoidsSoANext = BoidSoA();
+            BoidsSoANext.ResizeState(N);
+        }
+    } // implicit barrier
+}
+
+void NLayout::FirstTouch(const size_t *BoidIDs, const size_t N)
+{
+    for (size_t b = 0; b < N; b++)
+    {
+        const size_t i = BoidIDs[b];
+        BoidsSoAScratch.Copy(i, BoidsSoA, i);
+        if (IsDoubleBuffered())
+        {
+            // (its contents are overwritten every tick, only its placement matters)
+            BoidsSoANext.X[i] = BoidsSoANext.Y[i] = 0;
+            BoidsSoANext.VX[i] = BoidsSoANext.VY[i] = 0;
+        }
+    }
+}
+
+void NLayout::EndFirstTouch()
+{
+#pragma omp barrier
+#pragma omp single
+    {
+        std::swap(BoidsSoA, BoidsSoAScratch);
+        BoidsSoAScratch = BoidSoA();
+    } // implicit barrier
+}
+
+void NLayout::RebuildMembership()
+{
+    /// WARNING: this function must be called outside of all other flock operations
+    // (and by every thread of the tick's parallel region)
+    assert(UsingLayout == Global);
+    const size_t N = BoidsGlobal.size();
+    uint32_t *Owners = nullptr;
+#pragma omp single copyprivate(Owners)
+    {
+        Owners = Arena::Alloc<uint32_t>(N);
+        GlobalMembers.resize(N);
+    } // implicit barrier
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        assert(BoidsSoA.FlockIDs[i] == BoidsGlobal[i].FlockID);
+        assert(BoidsSoA.FlockIDs[i] + 1 < FlockStart.size());
+        Owners[i] = uint32_t(BoidsSoA.FlockIDs[i]);
+    } // implicit barrier
+    // (stable) radix sort by owner, so flockmates stay in increasing BoidID order
+    Morton::Sort(Owners, N, GlobalMembers.data());
+    // every flock starts where the first boid with an owner >= it is (which also
+    // leaves flocks that lost all their boids empty)
+    const size_t NumFlocks = FlockStart.size() - 1;
+#pragma omp for schedule(static)
+    for (size_t k = 0; k <= N; k++)
+    {
+        const size_t First = (k == 0) ? 0 : Owners[GlobalMembers[k - 1]] + 1;
+        const size_t Last = (k == N) ? NumFlocks : Owners[GlobalMembers[k]];
+        for (size_t F = First; F <= Last; F++)
+        {
+            FlockStart[F] = k;
+        }
+    }
+}
+
 bool NLayout::IsValid() const
 {
     /// WARNING: this function is not thread safe
@@ -38,10 +200,13 @@ bool NLayout::IsValid() const
     // ensure all flockmates are in the same flocks
     if (BoidsGlobal.size() > 0)
     {
-        for (size_t bID : BoidsGlobalData[FlockID].BoidIDs)
+        for (size_t k = GlobalBegin(); k < GlobalEnd(); k++)
         {
+            const size_t bID = GlobalMembers[k];
             if (BoidsGlobal[bID].FlockID != FlockID)
                 return false;
+            if (BoidsSoA.FlockIDs[bID] != FlockID)
+                return false;
         }
     }
     // auto Boids = GetBoids();
@@ -53,22 +218,24 @@ bool NLayout::IsValid() const
     // no boid left behind (VERY EXPENSIVE, only need to be done once)
     if (FlockID == 0) // arbitrary random FlockID
     {
-        size_t NumBoids = 0;
-        for (auto FD : BoidsGlobalData)
-        {
-            NumBoids += FD.second.Size();
-        }
-        if (NumBoids != BoidsGlobal.size())
+        if (GlobalMembers.size() != BoidsGlobal.size())
+            return false;
+        if (FlockStart.size() > 0 && FlockStart.back() != BoidsGlobal.size())
             return false;
     }
     /// LOCAL:
     // ensure all flockmates are in the same local flock
-    for (const Boid &B : BoidsLocal)
+    if (LocalIDs.size() != BoidsLocal.size())
+        return false;
+    for (size_t i = 0; i < BoidsLocal.size(); i++)
     {
+        const Boid &B = BoidsLocal[i];
         if (B.FlockID != FlockID)
             return false;
         if (!B.IsValid())
             return false;
+        if (LocalIDs[i] != B.BoidID)
+            return false;
     }
     return true;
 }
@@ -79,16 +246,29 @@ void NLayout::NewBoid(Flock *FP, const size_t FID)
     /// TODO: move to constructor
     assert(NewBoidStruct.IsValid());
     FlockID = FID;
+    // new boids are always appended to the end of the SoA
+    assert(NewBoidStruct.BoidID == BoidsSoA.Size());
+    BoidsSoA.Resize(NewBoidStruct.BoidID + 1);
+    StoreSoA(NewBoidStruct);
+    if (IsDoubleBuffered())
+        BoidsSoANext.ResizeState(BoidsSoA.Size());
     if (UsingLayout == Local)
     {
         BoidsLocal.push_back(NewBoidStruct);
+        LocalIDs.push_back(NewBoidStruct.BoidID);
     }
     else
     {
         assert(UsingLayout == Global);
         BoidsGlobal.push_back(NewBoidStruct);
-        // need to manually manage boid data
-        BoidsGlobalData[FlockID].Add(NewBoidStruct);
+        // need to manually manage boid data (new boids always join the last flock)
+        if (FlockStart.size() == 0)
+            FlockStart.push_back(0);
+        while (FlockStart.size() < FlockID + 2)
+            FlockStart.push_back(GlobalMembers.size()); // (empty flocks in between)
+        assert(FlockStart.size() == FlockID + 2);
+        GlobalMembers.push_back(NewBoidStruct.BoidID);
+        FlockStart[FlockID + 1] = GlobalMembers.size();
     }
     assert(IsValid());
 }
@@ -102,33 +282,35 @@ size_t NLayout::Size() const
     assert(UsingLayout == Global);
     if (BoidsGlobal.size() == 0)
         return 0;
-    return BoidsGlobalData[FlockID].Size();
+    return GlobalEnd() - GlobalBegin();
 }
 
-std::vector<Boid *> NLayout::GetBoids() const
+BoidRange NLayout::GetBoids() const
 {
     assert(IsValid());
+    /// NOTE: using const-cast to keep function marked const
+    // but allow edits to the underlying boids afterwards
     if (UsingLayout == Local)
     {
-        std::vector<Boid *> LocalFlock;
-        LocalFlock.reserve(BoidsLocal.size());
-        for (const Boid &B : BoidsLocal)
-        {
-            LocalFlock.push_back(const_cast<Boid *>(&B));
-        }
-        return LocalFlock;
+        return BoidRange(const_cast<Boid *>(BoidsLocal.data()), nullptr, BoidsLocal.size());
     }
     assert(UsingLayout == Global);
-    std::vector<Boid *> GlobalFlock;
-    const FlockData &FD = BoidsGlobalData.at(FlockID);
-    for (auto It = FD.BoidIDs.begin(); It != FD.BoidIDs.end(); It++)
+    if (BoidsGlobal.size() == 0)
+        return BoidRange(nullptr, nullptr, 0);
+    // the flock's BoidIDs are contiguous in GlobalMembers
+    return BoidRange(const_cast<Boid *>(BoidsGlobal.data()), GlobalMembers.data() + GlobalBegin(), Size());
+}
+
+const size_t *NLayout::GetBoidIDs() const
+{
+    if (UsingLayout == Local)
     {
-        // add all the BoidsGlobal one time rather than one at a time
-        assert((*It) < BoidsGlobal.size());
-        const Boid &B = BoidsGlobal[*It];
-        GlobalFlock.push_back(const_cast<Boid *>(&B));
+        return LocalIDs.data();
     }
-    return GlobalFlock;
+    assert(UsingLayout == Global);
+    if (BoidsGlobal.size() == 0)
+        return nullptr;
+    return GlobalMembers.data() + GlobalBegin();
 }
 
 std::vector<Boid> *NLayout::GetAllBoidsPtr() const
@@ -143,14 +325,12 @@ std::vector<Boid> *NLayout::GetAllBoidsPtr() const
 
 Boid *NLayout::GetBoidF(const size_t Idx) const
 {
-    /// WARNING: this is cheap O(1) for Local but expensive O(N) for global!!
-    // if you're looking for a bunch of boids, instead use GetBoids
     if (UsingLayout == Global)
     {
         // since Idx is local to the flock, we'll need to find the flock's local
-        // neighbourhood boids
-        assert(Idx < BoidsGlobalData.at(FlockID).Size());
-        size_t GlobalIdx = BoidsGlobalData.at(FlockID).GetBoidIdx(Idx); // BoidID of global boid
+        // neighbourhood boids (still O(1), they are contiguous in GlobalMembers)
+        assert(Idx < Size());
+        size_t GlobalIdx = GlobalMembers[GlobalBegin() + Idx]; // BoidID of global boid
         assert(GlobalIdx < BoidsGlobal.size());
         return (*this)[GlobalIdx];
     }
@@ -177,6 +357,7 @@ void NLayout::ClearLocal()
     {
         assert(IsValid());
         BoidsLocal.clear();
+        LocalIDs.clear();
     }
 }
 
@@ -188,46 +369,77 @@ void NLayout::Destroy()
         ClearLocal();
     }
     assert(IsValid());
+    BoidsSoA.Resize(0);
     if (BoidsGlobal.size() > 0)
     {
         BoidsGlobal.clear();
-        for (auto It = BoidsGlobalData.begin(); It != BoidsGlobalData.end(); It++)
+        GlobalMembers.clear();
+        FlockStart.clear();
+    }
+}
+
+void NLayout::Reserve(const size_t NumImmigrants)
+{
+    if (UsingLayout == Local)
+    {
+        const bool Grow = BoidsLocal.size() + NumImmigrants > BoidsLocal.capacity();
+        if (Grow)
         {
-            FlockData &F = It->second;
-            F.BoidIDs.clear();
+            /// NOTE: a flock only takes immigrants while it is under max_size, so once it
+            // starts growing we jump straight to room for twice that (the pages past our
+            // boids are never touched), so steady-state ticks stop reallocating
+            const size_t Room = 2 * size_t(std::max(GlobalParams.FlockParams.MaxSize, 1));
+            BoidsLocal.reserve(std::max({BoidsLocal.size() + NumImmigrants, 2 * BoidsLocal.capacity(), Room}));
         }
-        BoidsGlobalData.clear();
+        if (LocalIDs.capacity() < BoidsLocal.capacity())
+            LocalIDs.reserve(BoidsLocal.capacity());
     }
 }
 
-void NLayout::Append(const std::vector<Boid> &Immigrants)
+void NLayout::Immigrate(const NLayout &From, const size_t Idx)
 {
     if (UsingLayout == Local)
     {
-        // don't need a critical section bc writing to local, reading from remote
-        BoidsLocal.insert(BoidsLocal.end(), Immigrants.begin(), Immigrants.end());
-        assert(IsValid());
+        /// NOTE: don't need a critical section bc writing to local (already reserved,
+        // so never reallocated), reading from remote (whose emigrants are dropped later)
+        assert(Idx < From.BoidsLocal.size());
+        assert(BoidsLocal.size() < BoidsLocal.capacity() && LocalIDs.size() < LocalIDs.capacity());
+        BoidsLocal.push_back(From.BoidsLocal[Idx]);
+        Boid &B = BoidsLocal.back();
+        LocalIDs.push_back(B.BoidID);
+        B.FlockID = FlockID;
+        BoidsSoA.FlockIDs[B.BoidID] = FlockID;
     }
     else
     {
         assert(UsingLayout == Global);
-        for (const Boid &B : Immigrants)
+        // global boids never move, only their flock membership does
+        assert(Idx < BoidsGlobal.size());
+        assert(BoidsGlobal[Idx].FlockID == From.FlockID && From.FlockID != FlockID);
+        // no critical section needed since every emigrant has exactly one new flock
+        // (the per-flock BoidIDs are regrouped by RebuildMembership afterwards)
+        BoidsGlobal[Idx].FlockID = FlockID; // assign new FlockID to Boid
+        BoidsSoA.FlockIDs[Idx] = FlockID;   // (and to the SoA)
+    }
+}
+
+void NLayout::Emigrate(const std::pair<size_t, size_t> *Emigrants, const size_t NumEmigrants)
+{
+    if (UsingLayout == Local)
+    {
+        /// NOTE: the emigrants are in increasing index order, so filling the holes
+        // from the back (in reverse) never moves another emigrant and leaves every
+        // other boid where it is
+        for (size_t e = NumEmigrants; e-- > 0;)
         {
-            const size_t Idx = B.BoidID;
-            if (BoidsGlobal[Idx].FlockID == FlockID)
-            {
-                continue; // don't need to remove/readd them
-            }
-            assert(Idx < BoidsGlobal.size());
-            assert(Idx < BoidsGlobalData.size());
-#pragma omp critical
-            {
-                // should be O(1) complexity
-                BoidsGlobalData.at(BoidsGlobal[Idx].FlockID).Remove(B); // remove old
-                BoidsGlobal[Idx].FlockID = FlockID;                     // assign new FlockID to Boid
-                BoidsGlobalData.at(FlockID).Add(B);                     // add new to my flock
-                assert(IsValid());
-            }
+            const size_t Idx = Emigrants[e].first;
+            assert(Idx < BoidsLocal.size());
+            BoidsLocal[Idx] = BoidsLocal.back();
+            BoidsLocal.pop_back();
+            LocalIDs[Idx] = LocalIDs.back();
+            LocalIDs.pop_back();
         }
+        assert(IsValid());
     }
-}
\ No newline at end of file
+    // (global emigrants were already removed from our flock by their new flock)
+}
@@ -4,8 +4,130 @@
 #include "Boid.hpp"
 #include "Vec.hpp"
 #include <iterator>      // std::advance
-#include <unordered_map> // std::unordered_map
-#include <unordered_set> // std::unordered_set
+#include <utility>       // std::pair
+
+struct BoidSoA // hot boid data (read in every interaction) as a structure of arrays
+{
+    // each array is 64-byte aligned and contiguous so the Plan loop only streams
+    // through the data it actually reads
+    AlignedVector<float> X, Y, VX, VY;
+    AlignedVector<size_t> FlockIDs, BoidIDs;
+    size_t Size() const
+    {
+        return X.size();
+    }
+    void Resize(const size_t N)
+    {
+        X.resize(N);
+        Y.resize(N);
+        VX.resize(N);
+        VY.resize(N);
+        FlockIDs.resize(N);
+        BoidIDs.resize(N);
+    }
+    void Store(const size_t Idx, const Boid &B)
+    {
+        assert(Idx < Size());
+        X[Idx] = B.Position[0];
+        Y[Idx] = B.Position[1];
+        VX[Idx] = B.Velocity[0];
+        VY[Idx] = B.Velocity[1];
+        FlockIDs[Idx] = B.FlockID;
+        BoidIDs[Idx] = B.BoidID;
+    }
+    // (only the state that changes every tick, for a double buffered SoA)
+    void ResizeState(const size_t N)
+    {
+        X.resize(N);
+        Y.resize(N);
+        VX.resize(N);
+        VY.resize(N);
+    }
+    void StoreState(const size_t Idx, const Boid &B)
+    {
+        assert(Idx < Size());
+        X[Idx] = B.Position[0];
+        Y[Idx] = B.Position[1];
+        VX[Idx] = B.Velocity[0];
+        VY[Idx] = B.Velocity[1];
+    }
+    void SwapState(BoidSoA &Other)
+    {
+        X.swap(Other.X);
+        Y.swap(Other.Y);
+        VX.swap(Other.VX);
+        VY.swap(Other.VY);
+    }
+    void Copy(const size_t Idx, const BoidSoA &Other, const size_t OtherIdx)
+    {
+        assert(Idx < Size() && OtherIdx < Other.Size());
+        X[Idx] = Other.X[OtherIdx];
+        Y[Idx] = Other.Y[OtherIdx];
+        VX[Idx] = Other.VX[OtherIdx];
+        VY[Idx] = Other.VY[OtherIdx];
+        FlockIDs[Idx] = Other.FlockIDs[OtherIdx];
+        BoidIDs[Idx] = Other.BoidIDs[OtherIdx];
+    }
+};
+
+class BoidRange // non-allocating view over the boids of a flock (for both layouts)
+{
+  public:
+    BoidRange(Boid *Base, const size_t *Idxs, const size_t N) : Base(Base), Idxs(Idxs), N(N)
+    {
+    }
+    Boid *operator[](const size_t i) const
+    {
+        assert(i < N);
+        return (Idxs == nullptr) ? (Base + i) : (Base + Idxs[i]);
+    }
+    size_t Size() const
+    {
+        return N;
+    }
+    const size_t *GetIdxs() const
+    {
+        // BoidIDs of a global flock (nullptr for local flocks, which are contiguous)
+        return Idxs;
+    }
+    class Iterator
+    {
+      public:
+        Iterator(const BoidRange *R, const size_t i) : R(R), i(i)
+        {
+        }
+        Boid *operator*() const
+        {
+            return (*R)[i];
+        }
+        Iterator &operator++()
+        {
+            i++;
+            return *this;
+        }
+        bool operator!=(const Iterator &Other) const
+        {
+            return i != Other.i;
+        }
+
+      private:
+        const BoidRange *R;
+        size_t i;
+    };
+    Iterator begin() const
+    {
+        return Iterator(this, 0);
+    }
+    Iterator end() const
+    {
+        return Iterator(this, N);
+    }
+
+  private:
+    Boid *Base;         // local: the flock's boids, global: all the boids
+    const size_t *Idxs; // global: the flock's BoidIDs into Base
+    size_t N;
+};
 
 class NLayout // options bs local and global boid layout
 {
@@ -16,9 +138,16 @@ class NLayout // options bs local and global boid layout
     void ClearLocal();
     void Destroy();
     bool IsValid() const;
-    std::vector<Boid *> GetBoids() const;
+    BoidRange GetBoids() const;
+    // BoidIDs of our boids (in GetBoids' order), to read their hot state from the SoA
+    const size_t *GetBoidIDs() const;
     std::vector<Boid> *GetAllBoidsPtr() const;
-    void Append(const std::vector<Boid> &Immigrants);
+    // make room for NumImmigrants boids without reallocating
+    void Reserve(const size_t NumImmigrants);
+    // move the boid at Idx (local index or BoidID) of another flock's neighbourhood into ours
+    void Immigrate(const NLayout &From, const size_t Idx);
+    // drop all (index, destination) emigrants, which have already been immigrated
+    void Emigrate(const std::pair<size_t, size_t> *Emigrants, const size_t NumEmigrants);
     // for both layout types
     Boid *operator[](const size_t Idx) const;
     Boid *GetBoidF(const size_t Idx) const;
@@ -31,6 +160,26 @@ class NLayout // options bs local and global boid layout
     };
     static NLayout::Layout GetType();
     static void SetType(const NLayout::Layout L);
+    // hot boid state (for both layout types)
+    static const BoidSoA &GetSoA();
+    static void StoreSoA(const Boid &B);
+    // ping-pong the hot state: every boid senses last tick's SoA while writing the
+    // next tick's, so sensing & acting need no barrier in between
+    static bool IsDoubleBuffered();
+    static void StoreNextSoA(const Boid &B);
+    // make the next tick's state current (must not be called in parallel)
+    static void SwapSoA();
+    // sort the global boids by their position along a Z-order curve
+    // (called by every thread of the tick's parallel region)
+    static void Reorder();
+    // regroup the global boids by their (owning) FlockID (called like Reorder)
+    static void RebuildMembership();
+    // rewrite the hot boid state into fresh arrays, the BoidIDs passed to FirstTouch by
+    // the calling thread, so their pages land on its NUMA node (Begin/EndFirstTouch are
+    // called like Reorder, FirstTouch in between by whichever thread senses those boids)
+    static void BeginFirstTouch();
+    static void FirstTouch(const size_t *BoidIDs, const size_t N);
+    static void EndFirstTouch();
 
   private:
     static NLayout::Layout UsingLayout;
@@ -38,48 +187,40 @@ class NLayout // options bs local and global boid layout
     size_t FlockID;
     // for local (flock-based) neighbourhoods
     std::vector<Boid> BoidsLocal;
+    std::vector<size_t> LocalIDs; // (the BoidID of each of BoidsLocal)
     // for a global (boid-based) neighbourhood
-    struct FlockData
+    /// NOTE: the FlockID of each global boid is the source of truth for its membership,
+    // so flocks can exchange boids without locking (each boid has exactly one new owner)
+    // and GlobalMembers (all BoidIDs, grouped by flock) is rebuilt once they are done
+    static std::vector<size_t> GlobalMembers;
+    // need to manually keep track of where in BoidsGlobal each boid in a flock is:
+    // (CSR style) flock F's BoidIDs are GlobalMembers[FlockStart[F], FlockStart[F + 1])
+    static std::vector<size_t> FlockStart;
+    size_t GlobalBegin() const
     {
-        // need to manually keep track of where in BoidsGlobal each boid in a flock is
-        std::unordered_set<size_t> BoidIDs;
-        size_t GetBoidIdx(const size_t Idx) const
-        {
-            auto It = BoidIDs.begin();
-            for (size_t i = 0; i < Idx; i++)
-            {
-                // unfortunately linear in Idx, since the unordered_set iterator is
-                // a legacyForwardIterator (supports ++ in O(1))
-                // https://en.cppreference.com/w/cpp/named_req/ForwardIteratorz
-                It++;
-            }
-            return *It;
-        }
-        void Add(const Boid &B)
-        {
-            // add new Boid to the list of IDs
-            BoidIDs.insert(B.BoidID);
-        }
-        void Remove(const Boid &B)
-        {
-            // O(1) find BoidID in set
-            auto It = BoidIDs.find(B.BoidID);
-            assert(It != BoidIDs.end());
-            // O(1) erase from set
-            BoidIDs.erase(It);
-        }
-        size_t Size() const
-        {
-            return BoidIDs.size();
-        }
-    };
-    // per-flock boid data
-    static std::unordered_map<size_t, FlockData> BoidsGlobalData;
+        assert(FlockID + 1 < FlockStart.size());
+        return FlockStart[FlockID];
+    }
+    size_t GlobalEnd() const
+    {
+        assert(FlockID + 1 < FlockStart.size());
+        return FlockStart[FlockID + 1];
+    }
 
     /// NOTE: one important thing about the boids in BoidsGlobal is that
     // their position in the vector remains constant throughout the sim
     // (unlike the BoidsLocal which move around to impact locality)
+    // unless they are periodically reordered (which also renumbers their BoidIDs)
     static std::vector<Boid> BoidsGlobal;
+    static std::vector<Boid> BoidsGlobalScratch; // (for reordering)
+
+    /// NOTE: the positions, velocities, and flocks of all boids (indexed by BoidID) are
+    // also kept in a SoA that the hot (sensing) loops read from, in both layouts. It is
+    // a mirror of the Boid structs, which every write goes through first (see StoreSoA)
+    // & which the cold paths (delegation, rendering, etc.) still read
+    static BoidSoA BoidsSoA;
+    static BoidSoA BoidsSoAScratch; // (for reordering)
+    static BoidSoA BoidsSoANext;    // (only X, Y, VX, VY, when double buffered)
 };
 
 #endif
\ No newline at end of file
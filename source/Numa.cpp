@@ -0,0 +1,91 @@
+#include "Numa.hpp"
+#include "FlockMap.hpp"      // FlockMap
+#include "Neighbourhood.hpp" // NLayout
+#include "Scheduler.hpp"     // Scheduler
+#include <algorithm>         // std::max_element
+#include <iostream>          // std::cout
+#include <omp.h>             // OpenMP
+#include <sys/syscall.h>     // SYS_getcpu, SYS_move_pages
+#include <unistd.h>          // syscall, sysconf
+
+// declaring static variables
+std::vector<int> Numa::ThreadNodes;
+
+void Numa::Init()
+{
+    ThreadNodes.assign(std::max(1, GlobalParams.SimulatorParams.NumThreads), 0);
+}
+
+bool Numa::IsEnabled()
+{
+    return GlobalParams.SimulatorParams.UseNuma;
+}
+
+void Numa::Bind()
+{
+    if (!IsEnabled())
+        return;
+    /// NOTE: the raw syscalls (rather than libnuma) keep this dependency free, on
+    // kernels without NUMA support every thread & page is simply on node 0
+    unsigned CPU = 0, Node = 0;
+    if (syscall(SYS_getcpu, &CPU, &Node, nullptr) == 0)
+        ThreadNodes[omp_get_thread_num()] = Node;
+#pragma omp barrier
+#pragma omp single nowait
+    {
+        std::cout << "Threads on NUMA nodes: [";
+        for (const int N : ThreadNodes)
+        {
+            std::cout << N << ", ";
+        }
+        std::cout << "]" << std::endl;
+    }
+}
+
+void Numa::Place(const FlockMap &AllFlocks)
+{
+    if (!IsEnabled())
+        return;
+    /// NOTE: a flock senses its boids (and mostly those of its neighbours, which share
+    // its thread under affinity) on the thread it is planned on, so each flock's lines
+    // are touched from there (not in static BoidID chunks, which ignore the flocks)
+    NLayout::BeginFirstTouch();
+    Scheduler::ForEach(AllFlocks.Size(), [&AllFlocks](const size_t i) {
+        const Flock &F = AllFlocks[i];
+        NLayout::FirstTouch(F.Neighbourhood.GetBoidIDs(), F.Size());
+    });
+    NLayout::EndFirstTouch();
+}
+
+int Numa::NodeOf(const size_t TID)
+{
+    return (TID < ThreadNodes.size()) ? ThreadNodes[TID] : 0;
+}
+
+int Numa::ThisNode()
+{
+    return NodeOf(omp_get_thread_num());
+}
+
+size_t Numa::NumNodes()
+{
+    return *std::max_element(ThreadNodes.begin(), ThreadNodes.end()) + 1;
+}
+
+size_t Numa::PageSize()
+{
+    static const size_t Size = sysconf(_SC_PAGESIZE);
+    return Size;
+}
+
+void Numa::PageNodes(const void *Begin, const size_t NumPages, int *Nodes)
+{
+    // move_pages without target nodes only reports where every page currently is
+    std::vector<void *> Pages(NumPages);
+    for (size_t p = 0; p < NumPages; p++)
+    {
+        Pages[p] = const_cast<char *>(static_cast<const char *>(Begin) + p * PageSize());
+    }
+    if (NumPages > 0 && syscall(SYS_move_pages, 0, NumPages, Pages.data(), nullptr, Nodes, 0) != 0)
+        std::fill(Nodes, Nodes + NumPages, -1);
+}
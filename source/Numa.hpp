@@ -0,0 +1,33 @@
+#ifndef NUMA
+#define NUMA
+
+#include "Utils.hpp" // Params
+#include <cstddef>   // size_t
+#include <vector>    // std::vector
+
+class FlockMap; // fwd declaration of the flock container
+
+class Numa // NUMA-aware placement of the threads & the boid storage
+{
+  public:
+    static void Init();
+    static bool IsEnabled();
+    // records the node of the calling (already pinned) thread (called by every thread
+    // at the start of the simulation's parallel region)
+    static void Bind();
+    // first touches every flock's hot boid state from the thread it was planned on
+    // (called by every thread of the first tick, after Scheduler::Plan)
+    static void Place(const FlockMap &AllFlocks);
+    // node that a thread runs on (0 if unknown)
+    static int NodeOf(const size_t TID);
+    static int ThisNode();
+    static size_t NumNodes();
+    // node holding each of the NumPages pages from Begin onwards (-1 if unknown)
+    static void PageNodes(const void *Begin, const size_t NumPages, int *Nodes);
+    static size_t PageSize();
+
+  private:
+    static std::vector<int> ThreadNodes;
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include "PlanKernel.hpp"
+#include <algorithm>   // std::min
+#include <immintrin.h> // SIMD intrinsics
+
+/// NOTE: every kernel computes exactly what Boid::Plan does for each boid in the batch:
+// skip self, skip boids further than the neighbourhood radius, accumulate the
+// center-of-mass & velocity of the rest, and separate from those within the
+// collision radius. Only the order of the floating point sums differs.
+
+static void PlanScalar(const PlanKernel::Args &A, PlanKernel::Sums &Out)
+{
+    for (size_t i = 0; i < A.N; i++)
+    {
+        if (A.BoidIDs[i] == A.Self)
+            continue; // don't plan with self
+        const float DX = A.X[i] - A.PosX;
+        const float DY = A.Y[i] - A.PosY;
+        const float DistSqr = DX * DX + DY * DY;
+        if (DistSqr > A.NeighbourhoodRadiusSqr)
+            continue; // too far away: ignore
+        Out.COMX += A.X[i];
+        Out.COMY += A.Y[i];
+        Out.VelX += A.VX[i];
+        Out.VelY += A.VY[i];
+        if (DistSqr < A.CollisionRadiusSqr)
+        {
+            Out.SepX -= DX;
+            Out.SepY -= DY;
+        }
+        Out.NumCloseby++;
+    }
+}
+
+__attribute__((target("avx2"))) static float HorizontalSum(const __m256 V)
+{
+    const __m128 Lo = _mm256_castps256_ps128(V);
+    const __m128 Hi = _mm256_extractf128_ps(V, 1);
+    __m128 Sum = _mm_add_ps(Lo, Hi);
+    Sum = _mm_hadd_ps(Sum, Sum);
+    Sum = _mm_hadd_ps(Sum, Sum);
+    return _mm_cvtss_f32(Sum);
+}
+
+__attribute__((target("avx2"))) static void PlanAVX2(const PlanKernel::Args &A, PlanKernel::Sums &Out)
+{
+    // 8 candidate neighbours at a time
+    const size_t W = 8;
+    const __m256 PosX = _mm256_set1_ps(A.PosX);
+    const __m256 PosY = _mm256_set1_ps(A.PosY);
+    const __m256 NRad = _mm256_set1_ps(A.NeighbourhoodRadiusSqr);
+    const __m256 CRad = _mm256_set1_ps(A.CollisionRadiusSqr);
+    const __m256i Self = _mm256_set1_epi64x(static_cast<long long>(A.Self));
+    __m256 COMX = _mm256_setzero_ps(), COMY = _mm256_setzero_ps();
+    __m256 VelX = _mm256_setzero_ps(), VelY = _mm256_setzero_ps();
+    __m256 SepX = _mm256_setzero_ps(), SepY = _mm256_setzero_ps();
+    size_t NumCloseby = 0;
+    size_t i = 0;
+    for (; i + W <= A.N; i += W)
+    {
+        const __m256 X = _mm256_loadu_ps(A.X + i);
+        const __m256 Y = _mm256_loadu_ps(A.Y + i);
+        const __m256 DX = _mm256_sub_ps(X, PosX);
+        const __m256 DY = _mm256_sub_ps(Y, PosY);
+        const __m256 DistSqr = _mm256_add_ps(_mm256_mul_ps(DX, DX), _mm256_mul_ps(DY, DY));
+        // lanes holding self (two halves of 4 64-bit IDs each)
+        const __m256i IDLo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(A.BoidIDs + i));
+        const __m256i IDHi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(A.BoidIDs + i + 4));
+        const int IsSelf = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(IDLo, Self))) |
+                           (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(IDHi, Self))) << 4);
+        int Near = _mm256_movemask_ps(_mm256_cmp_ps(DistSqr, NRad, _CMP_NGT_UQ)) & ~IsSelf;
+        if (Near == 0)
+            continue; // nobody in this batch is close enough
+        // expand the lane mask back into a vector mask
+        const __m256i Bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256 NearV =
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(Near), Bits), Bits));
+        const __m256 CloseV = _mm256_and_ps(NearV, _mm256_cmp_ps(DistSqr, CRad, _CMP_LT_OQ));
+        COMX = _mm256_add_ps(COMX, _mm256_and_ps(NearV, X));
+        COMY = _mm256_add_ps(COMY, _mm256_and_ps(NearV, Y));
+        VelX = _mm256_add_ps(VelX, _mm256_and_ps(NearV, _mm256_loadu_ps(A.VX + i)));
+        VelY = _mm256_add_ps(VelY, _mm256_and_ps(NearV, _mm256_loadu_ps(A.VY + i)));
+        SepX = _mm256_sub_ps(SepX, _mm256_and_ps(CloseV, DX));
+        SepY = _mm256_sub_ps(SepY, _mm256_and_ps(CloseV, DY));
+        NumCloseby += __builtin_popcount(Near);
+    }
+    Out.COMX += HorizontalSum(COMX);
+    Out.COMY += HorizontalSum(COMY);
+    Out.VelX += HorizontalSum(VelX);
+    Out.VelY += HorizontalSum(VelY);
+    Out.SepX += HorizontalSum(SepX);
+    Out.SepY += HorizontalSum(SepY);
+    Out.NumCloseby += NumCloseby;
+    // leftovers (less than a full batch)
+    PlanKernel::Args Tail = A;
+    Tail.X += i;
+    Tail.Y += i;
+    Tail.VX += i;
+    Tail.VY += i;
+    Tail.BoidIDs += i;
+    Tail.N -= i;
+    PlanScalar(Tail, Out);
+}
+
+__attribute__((target("avx512f"))) static float HorizontalSum(const __m512 V)
+{
+    /// NOTE: not using _mm512_reduce_add_ps since it trips -Wuninitialized in gcc's headers
+    alignas(64) float Lanes[16];
+    _mm512_store_ps(Lanes, V);
+    float Sum = 0;
+    for (size_t i = 0; i < 16; i++)
+    {
+        Sum += Lanes[i];
+    }
+    return Sum;
+}
+
+__attribute__((target("avx512f"))) static void PlanAVX512(const PlanKernel::Args &A, PlanKernel::Sums &Out)
+{
+    // 16 candidate neighbours at a time
+    const size_t W = 16;
+    const __m512 PosX = _mm512_set1_ps(A.PosX);
+    const __m512 PosY = _mm512_set1_ps(A.PosY);
+    const __m512 NRad = _mm512_set1_ps(A.NeighbourhoodRadiusSqr);
+    const __m512 CRad = _mm512_set1_ps(A.CollisionRadiusSqr);
+    const __m512i Self = _mm512_set1_epi64(static_cast<long long>(A.Self));
+    __m512 COMX = _mm512_setzero_ps(), COMY = _mm512_setzero_ps();
+    __m512 VelX = _mm512_setzero_ps(), VelY = _mm512_setzero_ps();
+    __m512 SepX = _mm512_setzero_ps(), SepY = _mm512_setzero_ps();
+    size_t NumCloseby = 0;
+    for (size_t i = 0; i < A.N; i += W)
+    {
+        // the final batch is masked off rather than handled with a scalar loop
+        const __mmask16 Valid = (A.N - i >= W) ? __mmask16(0xFFFF) : __mmask16((1u << (A.N - i)) - 1);
+        const __m512 X = _mm512_maskz_loadu_ps(Valid, A.X + i);
+        const __m512 Y = _mm512_maskz_loadu_ps(Valid, A.Y + i);
+        const __m512 DX = _mm512_sub_ps(X, PosX);
+        const __m512 DY = _mm512_sub_ps(Y, PosY);
+        const __m512 DistSqr = _mm512_add_ps(_mm512_mul_ps(DX, DX), _mm512_mul_ps(DY, DY));
+        // lanes holding self (two halves of 8 64-bit IDs each)
+        const __m512i IDLo = _mm512_maskz_loadu_epi64(__mmask8(Valid), A.BoidIDs + i);
+        const __m512i IDHi = _mm512_maskz_loadu_epi64(__mmask8(Valid >> 8), A.BoidIDs + i + 8);
+        const __mmask16 IsSelf = __mmask16(_mm512_cmpeq_epi64_mask(IDLo, Self)) |
+                                 __mmask16(_mm512_cmpeq_epi64_mask(IDHi, Self) << 8);
+        const __mmask16 Near = _mm512_mask_cmp_ps_mask(Valid & ~IsSelf, DistSqr, NRad, _CMP_NGT_UQ);
+        if (Near == 0)
+            continue; // nobody in this batch is close enough
+        const __mmask16 Close = _mm512_mask_cmp_ps_mask(Near, DistSqr, CRad, _CMP_LT_OQ);
+        COMX = _mm512_mask_add_ps(COMX, Near, COMX, X);
+        COMY = _mm512_mask_add_ps(COMY, Near, COMY, Y);
+        VelX = _mm512_mask_add_ps(VelX, Near, VelX, _mm512_maskz_loadu_ps(Near, A.VX + i));
+        VelY = _mm512_mask_add_ps(VelY, Near, VelY, _mm512_maskz_loadu_ps(Near, A.VY + i));
+        SepX = _mm512_mask_sub_ps(SepX, Close, SepX, DX);
+        SepY = _mm512_mask_sub_ps(SepY, Close, SepY, DY);
+        NumCloseby += __builtin_popcount(Near);
+    }
+    Out.COMX += HorizontalSum(COMX);
+    Out.COMY += HorizontalSum(COMY);
+    Out.VelX += HorizontalSum(VelX);
+    Out.VelY += HorizontalSum(VelY);
+    Out.SepX += HorizontalSum(SepX);
+    Out.SepY += HorizontalSum(SepY);
+    Out.NumCloseby += NumCloseby;
+}
+
+// declaring static variables
+PlanKernel::KernelFn PlanKernel::Kernel = PlanScalar;
+const char *PlanKernel::KernelName = "scalar";
+
+void PlanKernel::Init()
+{
+    Kernel = PlanScalar;
+    KernelName = "scalar";
+    if (!GlobalParams.BoidParams.UseSIMD)
+        return; // scalar fallback
+    // pick the widest kernel this cpu supports
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        Kernel = PlanAVX512;
+        KernelName = "AVX-512";
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        Kernel = PlanAVX2;
+        KernelName = "AVX2";
+    }
+}
+
+const char *PlanKernel::Name()
+{
+    return KernelName;
+}
+
+static void AddSums(const PlanKernel::Sums &S, Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep, size_t &NumCloseby)
+{
+    RelCOM += Vec2D(S.COMX, S.COMY);
+    RelCOV += Vec2D(S.VelX, S.VelY);
+    Sep += Vec2D(S.SepX, S.SepY);
+    NumCloseby += S.NumCloseby;
+}
+
+void PlanKernel::Plan(const BoidSoA &S, const size_t Begin, const size_t End, const Vec2D &Pos, const size_t BoidID,
+                      Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep, size_t &NumCloseby)
+{
+    assert(Begin <= End && End <= S.Size());
+    if (Begin == End)
+        return;
+    const float NRad = GlobalParams.BoidParams.NeighbourhoodRadius;
+    const float CRad = GlobalParams.BoidParams.CollisionRadius;
+    const Args A = {S.X.data() + Begin,
+                    S.Y.data() + Begin,
+                    S.VX.data() + Begin,
+                    S.VY.data() + Begin,
+                    S.BoidIDs.data() + Begin,
+                    End - Begin,
+                    Pos[0],
+                    Pos[1],
+                    BoidID,
+                    sqr(NRad),
+                    sqr(CRad)};
+    Sums Out;
+    Kernel(A, Out);
+    AddSums(Out, RelCOM, RelCOV, Sep, NumCloseby);
+}
+
+void PlanKernel::PlanGather(const BoidSoA &S, const size_t *Idxs, const size_t NumIdxs, const Vec2D &Pos,
+                            const size_t BoidID, Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep, size_t &NumCloseby)
+{
+    /// NOTE: the scattered boids are first packed into a small (cache-resident) batch
+    // so the kernels only ever see contiguous arrays
+    const size_t BatchSize = 256;
+    alignas(64) float X[BatchSize], Y[BatchSize], VX[BatchSize], VY[BatchSize];
+    alignas(64) size_t IDs[BatchSize];
+    const float NRad = GlobalParams.BoidParams.NeighbourhoodRadius;
+    const float CRad = GlobalParams.BoidParams.CollisionRadius;
+    Sums Out;
+    for (size_t Start = 0; Start < NumIdxs; Start += BatchSize)
+    {
+        const size_t N = std::min(BatchSize, NumIdxs - Start);
+        for (size_t i = 0; i < N; i++)
+        {
+            const size_t Idx = Idxs[Start + i];
+            assert(Idx < S.Size());
+            X[i] = S.X[Idx];
+            Y[i] = S.Y[Idx];
+            VX[i] = S.VX[Idx];
+            VY[i] = S.VY[Idx];
+            IDs[i] = S.BoidIDs[Idx];
+        }
+        const Args A = {X, Y, VX, VY, IDs, N, Pos[0], Pos[1], BoidID, sqr(NRad), sqr(CRad)};
+        Kernel(A, Out);
+    }
+    AddSums(Out, RelCOM, RelCOV, Sep, NumCloseby);
+}
@@ -0,0 +1,46 @@
+#ifndef PLAN_KERNEL
+#define PLAN_KERNEL
+
+#include "Neighbourhood.hpp" // BoidSoA
+#include "Utils.hpp"         // Params
+#include "Vec.hpp"           // Vec2D
+#include <vector>            // std::vector
+
+class PlanKernel // batched (SIMD) version of Boid::Plan over the SoA
+{
+  public:
+    static void Init();
+    static const char *Name();
+    // plan against the contiguous boids [Begin, End) of the SoA
+    static void Plan(const BoidSoA &S, const size_t Begin, const size_t End, const Vec2D &Pos, const size_t BoidID,
+                     Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep, size_t &NumCloseby);
+    // plan against the (scattered) boids at Idxs[0, NumIdxs) of the SoA
+    static void PlanGather(const BoidSoA &S, const size_t *Idxs, const size_t NumIdxs, const Vec2D &Pos,
+                           const size_t BoidID, Vec2D &RelCOM, Vec2D &RelCOV, Vec2D &Sep, size_t &NumCloseby);
+
+    struct Sums // per-batch accumulators
+    {
+        float COMX = 0, COMY = 0;
+        float VelX = 0, VelY = 0;
+        float SepX = 0, SepY = 0;
+        size_t NumCloseby = 0;
+    };
+
+    struct Args // everything a kernel reads
+    {
+        const float *X, *Y, *VX, *VY;
+        const size_t *BoidIDs;
+        size_t N;
+        float PosX, PosY;
+        size_t Self;
+        float NeighbourhoodRadiusSqr, CollisionRadiusSqr;
+    };
+
+  private:
+    typedef void (*KernelFn)(const Args &A, Sums &Out);
+    // selected once (by CPUID) in Init
+    static KernelFn Kernel;
+    static const char *KernelName;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "RenderQueue.hpp"
+#include "TileRenderer.hpp" // drawing the frames
+#include <chrono>           // timing
+#include <iostream>         // std::cout
+
+// declaring static variables
+std::vector<RenderQueue::Frame> RenderQueue::Frames;
+std::vector<RenderQueue::Frame *> RenderQueue::Free;
+std::deque<RenderQueue::Frame *> RenderQueue::Pending;
+std::mutex RenderQueue::Lock;
+std::condition_variable RenderQueue::FrameFreed;
+std::condition_variable RenderQueue::FrameSubmitted;
+bool RenderQueue::Stopping = false;
+std::vector<std::thread> RenderQueue::Threads;
+std::vector<Image> RenderQueue::Canvases;
+std::vector<double> RenderQueue::BusyTime;
+size_t RenderQueue::NumFrames = 0;
+size_t RenderQueue::NumStalls = 0;
+size_t RenderQueue::MaxPending = 0;
+double RenderQueue::StallTime = 0;
+
+void RenderQueue::Init()
+{
+    if (!IsEnabled())
+        return;
+    const size_t NumThreads = std::max(size_t(1), GlobalParams.ImageParams.RenderThreads);
+    Frames = std::vector<Frame>(GlobalParams.ImageParams.RenderQueue);
+    Free.clear();
+    for (Frame &F : Frames)
+    {
+        Free.push_back(&F);
+    }
+    Pending.clear();
+    Stopping = false;
+    NumFrames = NumStalls = MaxPending = 0;
+    StallTime = 0;
+    Canvases = std::vector<Image>(NumThreads);
+    BusyTime = std::vector<double>(NumThreads, 0);
+    for (size_t t = 0; t < NumThreads; t++)
+    {
+        Canvases[t].Init();
+        Threads.push_back(std::thread(RenderLoop, t));
+    }
+}
+
+bool RenderQueue::IsEnabled()
+{
+    return GlobalParams.SimulatorParams.RenderingMovie && GlobalParams.ImageParams.RenderQueue > 0;
+}
+
+RenderQueue::Frame *RenderQueue::Acquire()
+{
+    std::unique_lock<std::mutex> Guard(Lock);
+    if (Free.empty())
+    {
+        // back-pressure: the simulation can only get RenderQueue frames ahead
+        const auto Start = std::chrono::system_clock::now();
+        FrameFreed.wait(Guard, [] { return !Free.empty(); });
+        std::chrono::duration<double> Stall = std::chrono::system_clock::now() - Start;
+        StallTime += Stall.count();
+        NumStalls++;
+    }
+    Frame *F = Free.back();
+    Free.pop_back();
+    F->Idx = NumFrames++;
+    return F;
+}
+
+void RenderQueue::Submit(Frame *F)
+{
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Pending.push_back(F);
+        MaxPending = std::max(MaxPending, Pending.size());
+    }
+    FrameSubmitted.notify_one();
+}
+
+void RenderQueue::RenderLoop(const size_t TID)
+{
+    Image &I = Canvases[TID];
+    TileRenderer Raster; // (its bins are reused from frame to frame)
+    while (true)
+    {
+        Frame *F = nullptr;
+        {
+            std::unique_lock<std::mutex> Guard(Lock);
+            FrameSubmitted.wait(Guard, [] { return Stopping || !Pending.empty(); });
+            if (Pending.empty())
+                return; // (stopping, and every frame has been written)
+            F = Pending.front();
+            Pending.pop_front();
+        }
+        const auto Start = std::chrono::system_clock::now();
+        Raster.Draw(*F, I); // (on this thread alone, which also clears the canvas)
+        I.ExportPPMImage(F->Idx);
+        std::chrono::duration<double> Busy = std::chrono::system_clock::now() - Start;
+        BusyTime[TID] += Busy.count();
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Free.push_back(F);
+        }
+        FrameFreed.notify_one();
+    }
+}
+
+void RenderQueue::Finish()
+{
+    if (!IsEnabled())
+        return;
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Stopping = true;
+    }
+    FrameSubmitted.notify_all();
+    for (std::thread &T : Threads)
+    {
+        T.join();
+    }
+    Threads.clear();
+}
+
+void RenderQueue::Report()
+{
+    if (!IsEnabled())
+        return;
+    std::cout << "Rendered " << NumFrames << " frames on " << Canvases.size() << " render threads with "
+              << Frames.size() << " frame buffers (at most " << MaxPending << " queued)" << std::endl;
+    std::cout << "The simulation stalled " << NumStalls << " times for " << StallTime
+              << "s waiting for a free frame buffer" << std::endl;
+    for (size_t t = 0; t < BusyTime.size(); t++)
+    {
+        std::cout << "  render thread " << t << ": " << BusyTime[t] << "s drawing & writing" << std::endl;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef RENDER_QUEUE
+#define RENDER_QUEUE
+
+#include "Image.hpp"          // Image, Colour
+#include "Utils.hpp"          // Params
+#include <condition_variable> // std::condition_variable
+#include <deque>              // std::deque
+#include <mutex>              // std::mutex
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+class RenderQueue // bounded ring of frame snapshots, drawn & written by a pool of render threads
+{
+  public:
+    struct Sprite // all that is drawn of a boid
+    {
+        float X, Y, VX, VY;
+        Colour C;
+    };
+    struct Rect // (a flock's bounding box)
+    {
+        float TLX, TLY, BRX, BRY;
+    };
+    struct Frame
+    {
+        size_t Idx; // (which ppm file it is written to)
+        std::vector<Sprite> Boids;
+        std::vector<Rect> Boxes;
+    };
+    // spawns the render threads (if enabled)
+    static void Init();
+    static bool IsEnabled();
+    // a free frame buffer to snapshot the next frame into, blocks while the render
+    // threads are behind on every buffer (must not be called in parallel)
+    static Frame *Acquire();
+    // hand a snapshot over to the render threads
+    static void Submit(Frame *F);
+    // wait for every submitted frame to be written, then stop the render threads
+    static void Finish();
+    // print how often (and how long) the simulation waited on the render threads
+    static void Report();
+
+  private:
+    static void RenderLoop(const size_t TID);
+    static std::vector<Frame> Frames; // the ring (never reallocated once spawned)
+    // frames that can be filled, & filled frames in the order they were submitted
+    static std::vector<Frame *> Free;
+    static std::deque<Frame *> Pending;
+    static std::mutex Lock;
+    static std::condition_variable FrameFreed, FrameSubmitted;
+    static bool Stopping;
+    static std::vector<std::thread> Threads;
+    static std::vector<Image> Canvases; // one per render thread
+    static std::vector<double> BusyTime;
+    static size_t NumFrames, NumStalls, MaxPending;
+    static double StallTime;
+};
+
+#endif
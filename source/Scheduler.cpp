@@ -0,0 +1,334 @@
+#include "Scheduler.hpp"
+#include "Arena.hpp"  // per-tick partitions
+#include "Morton.hpp" // spreading flocks over their home threads
+#include <algorithm>  // std::sort
+#include <iostream>   // std::cout
+#include <sched.h>    // sched_setaffinity
+
+// declaring static variables
+std::vector<Scheduler::ThreadState> Scheduler::Threads;
+size_t *Scheduler::Items = nullptr;
+size_t Scheduler::NumItems = ~size_t(0); // (nothing planned yet)
+double Scheduler::LoopTime = 0;
+std::vector<int> Scheduler::LastTID;
+size_t Scheduler::NumRuns = 0;
+size_t Scheduler::NumMigrations = 0;
+size_t Scheduler::NumRehomed = 0;
+
+static uint64_t PackRange(const uint64_t Head, const uint64_t Tail)
+{
+    return (Head << 32) | Tail;
+}
+
+void Scheduler::Init()
+{
+    Threads = std::vector<ThreadState>(std::max(1, GlobalParams.SimulatorParams.NumThreads));
+    Items = nullptr;
+    NumItems = ~size_t(0);
+    LoopTime = 0;
+    LastTID.clear();
+    NumRuns = NumMigrations = NumRehomed = 0;
+}
+
+bool Scheduler::IsEnabled()
+{
+    return GlobalParams.SimulatorParams.UseWorkStealing || GlobalParams.SimulatorParams.UseAffinity;
+}
+
+void Scheduler::PinThread()
+{
+    if (!GlobalParams.SimulatorParams.UseAffinity && !GlobalParams.SimulatorParams.UseNuma)
+        return;
+    /// NOTE: the i'th thread gets the i'th core this process may run on (wrapping
+    // around when there are more threads than cores), pinning is only best effort
+    cpu_set_t Allowed;
+    if (sched_getaffinity(0, sizeof(Allowed), &Allowed) != 0 || CPU_COUNT(&Allowed) == 0)
+        return;
+    int Skip = omp_get_thread_num() % CPU_COUNT(&Allowed);
+    for (int CPU = 0; CPU < CPU_SETSIZE; CPU++)
+    {
+        if (!CPU_ISSET(CPU, &Allowed) || Skip-- > 0)
+            continue;
+        cpu_set_t Core;
+        CPU_ZERO(&Core);
+        CPU_SET(CPU, &Core);
+        sched_setaffinity(0, sizeof(Core), &Core);
+        return;
+    }
+}
+
+size_t Scheduler::EstimateCost(const Flock &F)
+{
+    /// NOTE: sensing dominates a flock's work, so the boids it sensed last tick are
+    // a good estimate (flocks that have not sensed yet are costed by their size)
+    return std::max(F.Interactions, F.Size());
+}
+
+void Scheduler::Plan(FlockMap &AllFlocks)
+{
+    if (!IsEnabled())
+        return;
+#pragma omp single
+    {
+        const size_t N = AllFlocks.Size();
+        const size_t NumThreads = Threads.size();
+        assert(N < (uint64_t(1) << 32));
+        size_t *Costs = Arena::Alloc<size_t>(N);
+        size_t *Order = Arena::Alloc<size_t>(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            Costs[i] = EstimateCost(AllFlocks[i]);
+            Order[i] = i;
+        }
+        std::sort(Order, Order + N, [Costs](const size_t A, const size_t B) { return Costs[A] > Costs[B]; });
+        CountMigrations(AllFlocks);
+        size_t *Owner = Arena::Alloc<size_t>(N);
+        if (GlobalParams.SimulatorParams.UseAffinity)
+            AssignByHome(AllFlocks, Costs, Owner);
+        else
+            AssignByCost(Costs, Order, N, Owner);
+        size_t *Count = Arena::Alloc<size_t>(NumThreads);
+        std::fill(Count, Count + NumThreads, 0);
+        for (size_t i = 0; i < N; i++)
+        {
+            Count[Owner[i]]++;
+        }
+        // lay every thread's flocks out contiguously (still largest first)
+        size_t Start = 0;
+        for (size_t t = 0; t < NumThreads; t++)
+        {
+            Threads[t].Start = Threads[t].End = Start;
+            Start += Count[t];
+        }
+        Items = Arena::Alloc<size_t>(N);
+        for (size_t k = 0; k < N; k++)
+        {
+            Items[Threads[Owner[Order[k]]].End++] = Order[k];
+        }
+        NumItems = N;
+    } // implicit barrier
+}
+
+void Scheduler::AssignByCost(const size_t *Costs, const size_t *Order, const size_t N, size_t *Owner)
+{
+    // longest processing time first, hand every flock to the least loaded thread
+    const size_t NumThreads = Threads.size();
+    size_t *Load = Arena::Alloc<size_t>(NumThreads);
+    std::fill(Load, Load + NumThreads, 0);
+    for (size_t k = 0; k < N; k++)
+    {
+        const size_t Least = std::min_element(Load, Load + NumThreads) - Load;
+        Owner[Order[k]] = Least;
+        Load[Least] += Costs[Order[k]];
+    }
+}
+
+void Scheduler::AssignByHome(FlockMap &AllFlocks, const size_t *Costs, size_t *Owner)
+{
+    const size_t N = AllFlocks.Size();
+    const size_t NumThreads = Threads.size();
+    size_t *Load = Arena::Alloc<size_t>(NumThreads);
+    std::fill(Load, Load + NumThreads, 0);
+    size_t TotalCost = 0, NumHomeless = 0;
+    size_t *Homeless = Arena::Alloc<size_t>(N);
+    uint32_t *Keys = Arena::Alloc<uint32_t>(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        const Flock &F = AllFlocks[i];
+        TotalCost += Costs[i];
+        if (F.HomeTID >= 0 && size_t(F.HomeTID) < NumThreads)
+        {
+            Load[F.HomeTID] += Costs[i];
+            continue;
+        }
+        const Vec2D C = F.BB.Centroid();
+        Keys[i] = Morton::Encode(C[0], C[1]);
+        Homeless[NumHomeless++] = i;
+    }
+    /// NOTE: flocks without a home (ie. on the first tick) are handed out in Morton
+    // order, filling each thread up to its share of the cost, so that every thread
+    // owns a compact region of the world and most neighbour reads stay on-thread
+    std::sort(Homeless, Homeless + NumHomeless, [Keys](const size_t A, const size_t B) { return Keys[A] < Keys[B]; });
+    const size_t Share = (TotalCost + NumThreads - 1) / NumThreads;
+    size_t T = 0;
+    for (size_t k = 0; k < NumHomeless; k++)
+    {
+        const size_t i = Homeless[k];
+        while (T + 1 < NumThreads && Load[T] + Costs[i] / 2 > Share)
+            T++;
+        AllFlocks[i].HomeTID = T;
+        Load[T] += Costs[i];
+    }
+    const double Limit = (1 + GlobalParams.SimulatorParams.AffinityImbalance) * double(TotalCost) / NumThreads;
+    /// NOTE: flocks drift (and grow) across the world, so a flock whose nearby flocks
+    // mostly live on another thread follows them there (if that keeps it under the
+    // limit), otherwise its homes would end up scattered & most reads cross threads
+    size_t *Pull = Arena::Alloc<size_t>(NumThreads);
+    for (size_t i = 0; i < N; i++)
+    {
+        Flock &F = AllFlocks[i];
+        std::fill(Pull, Pull + NumThreads, 0);
+        for (size_t n = 0; n < F.NumNearby; n++) // (incl. ourselves, so we don't flip-flop)
+        {
+            const Flock *Other = F.NearbyFlocks[n];
+            Pull[Other->HomeTID] += Other->Size();
+        }
+        const size_t Best = std::max_element(Pull, Pull + NumThreads) - Pull;
+        if (Pull[Best] > Pull[F.HomeTID] && Load[Best] + Costs[i] <= Limit)
+        {
+            Load[F.HomeTID] -= Costs[i];
+            Load[Best] += Costs[i];
+            F.HomeTID = Best;
+            NumRehomed++;
+        }
+    }
+    // flocks only move for balance once the busiest thread is over the limit, and
+    // then only the largest ones that fit in half the gap to the least loaded thread
+    /// NOTE: the busiest load never grows & the least never shrinks, so a thread's gap
+    // only shrinks each time it is the busiest again, and a flock too large to move off
+    // it now never fits later. So every thread's flocks are sorted by cost (largest
+    // first) once, and each move pops the first one that fits off the busiest thread
+    // (the flocks it moves stay on the thread they moved to)
+    size_t *Start = Arena::Alloc<size_t>(NumThreads + 1);
+    std::fill(Start, Start + NumThreads + 1, 0);
+    for (size_t i = 0; i < N; i++)
+    {
+        Start[AllFlocks[i].HomeTID + 1]++;
+    }
+    for (size_t t = 0; t < NumThreads; t++)
+    {
+        Start[t + 1] += Start[t];
+    }
+    size_t *Next = Arena::Alloc<size_t>(NumThreads);
+    std::copy(Start, Start + NumThreads, Next);
+    size_t *ByCost = Arena::Alloc<size_t>(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        ByCost[Next[AllFlocks[i].HomeTID]++] = i;
+    }
+    for (size_t t = 0; t < NumThreads; t++)
+    {
+        std::sort(ByCost + Start[t], ByCost + Start[t + 1], [Costs](const size_t A, const size_t B) {
+            return Costs[A] > Costs[B] || (Costs[A] == Costs[B] && A < B);
+        });
+    }
+    std::copy(Start, Start + NumThreads, Next); // (the head of every thread's list)
+    for (size_t Moves = 0; Moves < N; Moves++)
+    {
+        const size_t Most = std::max_element(Load, Load + NumThreads) - Load;
+        const size_t Least = std::min_element(Load, Load + NumThreads) - Load;
+        if (Load[Most] <= Limit)
+            break;
+        const size_t Gap = (Load[Most] - Load[Least]) / 2;
+        while (Next[Most] < Start[Most + 1] && Costs[ByCost[Next[Most]]] > Gap)
+            Next[Most]++;
+        if (Next[Most] == Start[Most + 1])
+            break; // every flock on it is too large to move
+        const size_t Best = ByCost[Next[Most]++];
+        AllFlocks[Best].HomeTID = Least;
+        Load[Most] -= Costs[Best];
+        Load[Least] += Costs[Best];
+        NumRehomed++;
+    }
+    for (size_t i = 0; i < N; i++)
+    {
+        Owner[i] = AllFlocks[i].HomeTID;
+    }
+}
+
+void Scheduler::CountMigrations(const FlockMap &AllFlocks)
+{
+    // how often a flock is sensed by a different thread than on its previous tick
+    for (const Flock &F : AllFlocks)
+    {
+        if (F.TIDs.SenseAndPlan < 0)
+            continue; // not sensed yet
+        if (F.FlockID >= LastTID.size())
+            LastTID.resize(F.FlockID + 1, -1);
+        if (LastTID[F.FlockID] >= 0)
+        {
+            NumRuns++;
+            if (LastTID[F.FlockID] != F.TIDs.SenseAndPlan)
+                NumMigrations++;
+        }
+        LastTID[F.FlockID] = F.TIDs.SenseAndPlan;
+    }
+}
+
+void Scheduler::ResetDeques()
+{
+#pragma omp single
+    {
+        for (ThreadState &T : Threads)
+        {
+            T.Range.store(PackRange(T.Start, T.End), std::memory_order_relaxed);
+        }
+    } // implicit barrier
+}
+
+bool Scheduler::PopOwn(const size_t TID, size_t &Idx)
+{
+    std::atomic<uint64_t> &Range = Threads[TID].Range;
+    uint64_t R = Range.load(std::memory_order_relaxed);
+    while (true)
+    {
+        const uint64_t Head = R >> 32, Tail = R & 0xFFFFFFFF;
+        if (Head >= Tail)
+            return false;
+        // (on failure R is reloaded, since a thief took one off the tail)
+        if (Range.compare_exchange_weak(R, PackRange(Head + 1, Tail)))
+        {
+            Idx = Items[Head];
+            return true;
+        }
+    }
+}
+
+bool Scheduler::Steal(const size_t TID, size_t &Idx)
+{
+    /// NOTE: nothing is ever pushed during a loop, so once every deque has been
+    // seen empty there is no work left
+    const size_t NumThreads = Threads.size();
+    for (size_t k = 1; k < NumThreads; k++)
+    {
+        const size_t Victim = (TID + k) % NumThreads;
+        std::atomic<uint64_t> &Range = Threads[Victim].Range;
+        uint64_t R = Range.load(std::memory_order_relaxed);
+        while (true)
+        {
+            const uint64_t Head = R >> 32, Tail = R & 0xFFFFFFFF;
+            if (Head >= Tail)
+                break; // nothing left to steal here
+            if (Range.compare_exchange_weak(R, PackRange(Head, Tail - 1)))
+            {
+                Idx = Items[Tail - 1];
+                Threads[TID].NumSteals++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void Scheduler::Report()
+{
+    std::cout << "Per-thread busy time over " << LoopTime << "s of per-flock loops";
+    if (GlobalParams.SimulatorParams.UseWorkStealing)
+        std::cout << " (with work stealing)";
+    if (GlobalParams.SimulatorParams.UseAffinity)
+        std::cout << " (with affinity, " << NumRehomed << " flocks rehomed)";
+    std::cout << std::endl;
+    for (size_t t = 0; t < Threads.size(); t++)
+    {
+        const double Busy = (LoopTime > 0) ? 100.0 * Threads[t].BusyTime / LoopTime : 0;
+        std::cout << "  thread " << t << ": " << Threads[t].BusyTime << "s (" << Busy << "% busy)";
+        if (GlobalParams.SimulatorParams.UseWorkStealing)
+            std::cout << ", " << Threads[t].NumSteals << " steals";
+        std::cout << std::endl;
+    }
+    if (NumRuns > 0)
+    {
+        std::cout << "Flocks sensed on a different thread than their last tick: " << NumMigrations << " of "
+                  << NumRuns << " (" << 100.0 * NumMigrations / NumRuns << "%)" << std::endl;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+
+#include "FlockMap.hpp" // FlockMap
+#include "Utils.hpp"    // Params
+#include <atomic>       // std::atomic
+#include <cstdint>      // uint64_t
+#include <omp.h>        // OpenMP
+#include <vector>       // std::vector
+
+class Scheduler // size-aware work stealing (and/or sticky flock affinity) over the flocks
+{
+  public:
+    static void Init();
+    static bool IsEnabled();
+    // pins the calling thread to its own core (with affinity or numa, called by every
+    // thread at the start of the simulation's parallel region)
+    static void PinThread();
+    // partitions the flocks over the threads by their estimated cost (largest first),
+    // or over their home threads (with affinity), must be called by every thread of
+    // the tick's parallel region
+    static void Plan(FlockMap &AllFlocks);
+    // calls Body(i) once for every i < N, each thread first drains its own deque (if
+    // the flocks were planned) then steals from the others, falls back to a dynamic
+    // schedule otherwise (called by every thread of the tick's parallel region)
+    template <typename Fn> static void ForEach(const size_t N, Fn Body)
+    {
+        const size_t TID = omp_get_thread_num();
+        const double Start = omp_get_wtime();
+        if (!IsEnabled() || N != NumItems)
+        {
+#pragma omp for schedule(dynamic)
+            for (size_t i = 0; i < N; i++)
+            {
+                RunTimed(TID, Body, i);
+            } // implicit barrier
+        }
+        else
+        {
+            ResetDeques();
+            size_t Idx;
+            while (PopOwn(TID, Idx) || (GlobalParams.SimulatorParams.UseWorkStealing && Steal(TID, Idx)))
+            {
+                RunTimed(TID, Body, Idx);
+            }
+#pragma omp barrier
+        }
+        if (TID == 0)
+            LoopTime += omp_get_wtime() - Start;
+    }
+    // print how long every thread spent doing work (vs waiting) in the loops above
+    static void Report();
+
+  private:
+    template <typename Fn> static void RunTimed(const size_t TID, Fn &Body, const size_t Idx)
+    {
+        const double Start = omp_get_wtime();
+        Body(Idx);
+        Threads[TID].BusyTime += omp_get_wtime() - Start;
+    }
+    static void ResetDeques();
+    static bool PopOwn(const size_t TID, size_t &Idx);
+    static bool Steal(const size_t TID, size_t &Idx);
+    static size_t EstimateCost(const Flock &F);
+    // fill in the owning thread of every flock (called in a single)
+    static void AssignByCost(const size_t *Costs, const size_t *Order, const size_t N, size_t *Owner);
+    static void AssignByHome(FlockMap &AllFlocks, const size_t *Costs, size_t *Owner);
+    static void CountMigrations(const FlockMap &AllFlocks);
+    struct ThreadState
+    {
+        // the [Head, Tail) range (packed as Head << 32 | Tail) of this thread's deque
+        // in Items, the owner pops off the head and thieves off the tail
+        std::atomic<uint64_t> Range;
+        size_t Start = 0, End = 0; // (where the range starts every loop)
+        double BusyTime = 0;
+        size_t NumSteals = 0;
+        char Padding[64]; // so threads don't share cache lines
+    };
+    static std::vector<ThreadState> Threads;
+    // flock indices, grouped by owning thread (largest estimated cost first)
+    static size_t *Items;
+    static size_t NumItems;
+    static double LoopTime; // wall clock time spent in ForEach (incl. waiting)
+    // FlockID -> thread that sensed the flock on its last tick (-1 if it never has)
+    static std::vector<int> LastTID;
+    static size_t NumRuns, NumMigrations, NumRehomed;
+};
+
+#endif
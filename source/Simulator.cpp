@@ -1,11 +1,22 @@
-#include "Flock.hpp"  // Flocks
-#include "Tracer.hpp" // Tracer
-#include "Utils.hpp"  // Params
-#include "Vec.hpp"    // Vec3D
-#include <chrono>     // timing threads
-#include <omp.h>      // OpenMP
-#include <string>     // cout
-#include <vector>     // std::vector
+#include "Arena.hpp"        // Arena
+#include "Flock.hpp"        // Flocks
+#include "FlockMap.hpp"     // FlockMap
+#include "Grid.hpp"         // SpatialGrid
+#include "HeapCounter.hpp"  // HeapCounter
+#include "Numa.hpp"         // Numa
+#include "PlanKernel.hpp"   // SIMD kernels
+#include "RenderQueue.hpp"  // asynchronous rendering
+#include "Scheduler.hpp"    // Scheduler
+#include "TaskGraph.hpp"    // TaskGraph
+#include "TileRenderer.hpp" // TileRenderer
+#include "Tracer.hpp"       // Tracer
+#include "Utils.hpp"        // Params
+#include "Vec.hpp"          // Vec3D
+#include "Verlet.hpp"       // VerletList
+#include <chrono>           // timing threads
+#include <omp.h>            // OpenMP
+#include <string>           // cout
+#include <vector>           // std::vector
 
 class Simulator
 {
@@ -25,229 +36,407 @@ class Simulator
         std::string NeighMode = "LOCAL";
         if (!GlobalParams.FlockParams.UseLocalNeighbourhoods)
             NeighMode = "GLOBAL";
-        std::cout << "Parallelizing across " << ParAxis << " with a " << NeighMode << " neighbourhood layout"
-                  << std::endl;
+        std::cout << "Parallelizing across " << ParAxis << " with a " << NeighMode << " neighbourhood layout";
+        if (GlobalParams.FlockParams.UseSpatialGrid)
+            std::cout << " (+ spatial grid)";
+        std::cout << std::endl;
+        if (GlobalParams.FlockParams.ReorderInterval > 0 && GlobalParams.FlockParams.UseLocalNeighbourhoods)
+            std::cout << "Ignoring reorder_interval (only used by the GLOBAL neighbourhood layout)" << std::endl;
 
+        // Initialize the per-thread tick arenas (for transient buffers)
+        Arena::Init();
+        // Initialize the per-thread flock deques (if work stealing)
+        Scheduler::Init();
+        // Initialize the threads' NUMA nodes (if numa)
+        Numa::Init();
         // Initialize neighbourhood layout for flocks before use
         Flock::InitNeighbourhoodLayout();
+        // Initialize the uniform grid for neighbour queries (if used)
+        SpatialGrid::Init();
+        // Initialize the cached neighbour lists (if used)
+        VerletList::Init();
+        // Pick the widest planning kernel this cpu supports
+        PlanKernel::Init();
+        std::cout << "Planning with the " << PlanKernel::Name() << " kernel" << std::endl;
         // Spawn flocks
+        AllFlocks.Reserve(Params.NumBoids);
         for (size_t i = 0; i < Params.NumBoids; i++)
         {
-            AllFlocks[i] = Flock(i, 1);
+            AllFlocks.Insert(Flock(i, 1));
         }
 
         // begin tracking which flocks communicate with which
-        Tracer::InitFlockMatrix(AllFlocks.size());
+        Tracer::InitFlockMatrix(AllFlocks.Size());
 
         // initialize image frame
-        if (Params.RenderingMovie)
+        if (Params.RenderingMovie && !RenderQueue::IsEnabled())
         {
             // only allocate memory if we're gonna use it
             I.Init();
         }
+        // Spawn the render threads (if rendering asynchronously)
+        RenderQueue::Init();
     }
     static SimulatorParamsStruct Params;
-    /// TODO: we can use the SenseAndPlan flock optimization if we change this vector
-    // to an associative container (unordered_map) so we can get O(1) access regardless
-    // of the resizing
-    std::unordered_map<size_t, Flock> AllFlocks;
+    /// NOTE: the live flocks are contiguous (for cheap per-tick walks) and can still
+    // be found by their (stable) FlockID in O(1)
+    FlockMap AllFlocks;
     Image I;
+    RenderQueue::Frame Frame; // (what Render draws, when rendering synchronously)
+    TileRenderer Raster;
+    size_t NumTicks = 0;
+    /// NOTE: state shared by all threads of the simulation's parallel region (only
+    // ever written by a single thread, between barriers)
+    std::chrono::system_clock::time_point TickStart;
+    double ElapsedTime = 0;
+    bool Reordering = false;
+    Boid **LocalBoids = nullptr; // (only for local layouts)
+    size_t TickStartAllocs = 0, FirstTickAllocs = 0, LastTickAllocs = 0;
+    size_t SteadyAllocs = 0; // (in the ticks after warmup_ticks)
 
     void Finish()
     {
-        for (auto It = AllFlocks.begin(); It != AllFlocks.end(); It++)
+        for (Flock &F : AllFlocks)
         {
-            assert(It != AllFlocks.end());
-            Flock &F = It->second;
             F.Destroy();
             assert(F.Size() == 0);
         }
     }
 
-    void Simulate()
+    // (returns false if any tick after warmup_ticks touched the heap)
+    bool Simulate()
     {
-        double ElapsedTime = 0;
-        for (size_t i = 0; i < Params.NumIterations; i++)
+        /// NOTE: one parallel region for the whole simulation so threads are only forked
+        // (and joined) once, every thread runs every tick where the phases are separated
+        // by barriers and the serial steps are done by a single thread
+        const auto SimulateStart = std::chrono::system_clock::now();
+#pragma omp parallel num_threads(Params.NumThreads) // spawns threads
         {
-            ElapsedTime += Tick();
-            std::cout << "Tick: " << i << "\r" << std::flush; // carriage return, no newline
+            Scheduler::PinThread();
+            Numa::Bind(); // (records the threads' nodes once they are pinned)
+            for (size_t i = 0; i < Params.NumIterations; i++)
+            {
+                Tick();
+#pragma omp single nowait
+                std::cout << "Tick: " << i << "\r" << std::flush; // carriage return, no newline
+            }
         }
         std::cout << "Finished simulation! Took " << ElapsedTime << "s" << std::endl;
+        if (Params.RenderingMovie)
+        {
+            RenderQueue::Finish(); // (writes the frames still queued)
+            std::chrono::duration<double> WallTime = std::chrono::system_clock::now() - SimulateStart;
+            std::cout << "Took " << WallTime.count() << "s including rendering" << std::endl;
+            RenderQueue::Report();
+        }
+        /// NOTE: the first ticks warm up (grow) all the reused buffers, so only once the
+        // flocks stop growing should a tick not touch the heap at all
+        std::cout << "Heap allocations: " << FirstTickAllocs << " in the first tick, " << LastTickAllocs
+                  << " in the last" << std::endl;
+        if (Params.WarmupTicks > 0 && SteadyAllocs > 0)
+            std::cerr << "Heap allocations: " << SteadyAllocs << " after the first " << Params.WarmupTicks
+                      << " ticks (expected none)" << std::endl;
+        Scheduler::Report();
+        if (VerletList::IsEnabled())
+            std::cout << "Rebuilt the neighbour lists " << VerletList::NumRebuilds << "/" << VerletList::NumUpdates
+                      << " times (" << VerletList::AvgCandidates() << " candidates per boid)" << std::endl;
+        return (Params.WarmupTicks == 0 || SteadyAllocs == 0);
     }
 
-    double Tick()
+    void Tick()
     {
-        // Run our actual problem (boid computation)
-        auto StartTime = std::chrono::system_clock::now();
+        /// WARNING: this must be called by every thread of the simulation's parallel region
+#pragma omp single
+        {
+            // Run our actual problem (boid computation)
+            TickStart = std::chrono::system_clock::now();
+            TickStartAllocs = HeapCounter::NumAllocs();
+            // drop all of last tick's transient buffers
+            Arena::Reset();
 
 #ifndef NDEBUG
-        size_t BoidCount = 0;
-        for (auto It = AllFlocks.begin(); It != AllFlocks.end(); It++)
-        {
-            assert(It != AllFlocks.end());
-            const Flock &F = It->second;
-            BoidCount += F.Size();
-            for (const Boid *B : F.Neighbourhood.GetBoids())
+            size_t BoidCount = 0;
+            for (const Flock &F : AllFlocks)
             {
-                assert(B->IsValid());
+                BoidCount += F.Size();
+                for (const Boid *B : F.Neighbourhood.GetBoids())
+                {
+                    assert(B->IsValid());
+                }
             }
-        }
-        assert(Params.NumBoids == BoidCount);
+            assert(Params.NumBoids == BoidCount);
 #endif
-        std::vector<Flock *> AllFlocksVec = GetAllFlocksVector();
+            for (const Flock &F : AllFlocks)
+            {
+                Tracer::AddFlockSize(F.Size());
+            }
 
-        if (!Params.ParallelizeAcrossFlocks)
-            ParallelBoids(AllFlocksVec);
-        else
-            ParallelFlocks(AllFlocksVec);
-        UpdateFlocks(AllFlocksVec);
+            const size_t ReorderInterval = GlobalParams.FlockParams.ReorderInterval;
+            Reordering =
+                NLayout::GetType() == NLayout::Global && ReorderInterval > 0 && NumTicks % ReorderInterval == 0;
+            NumTicks++;
+        } // implicit barrier
 
-        auto EndTime = std::chrono::system_clock::now();
-        std::chrono::duration<double> ElapsedTime = EndTime - StartTime;
-        // save tracer data
-        Tracer::AddTickT(ElapsedTime.count());
+        if (Reordering)
+        {
+            // sort the global boids along a Z-order curve so neighbours share cache lines
+            auto ReorderStart = std::chrono::system_clock::now();
+            NLayout::Reorder();
+#pragma omp single
+            {
+                VerletList::Invalidate(); // the boids were renumbered
+                SpatialGrid::SetBinned(false);
+                std::chrono::duration<double> ReorderTime = std::chrono::system_clock::now() - ReorderStart;
+                Tracer::AddReorderT(ReorderTime.count());
+            } // implicit barrier
+        }
+        Tracer::AddStorageLocality(NLayout::GetSoA()); // (only reads the boids)
 
-        if (Params.RenderingMovie)
+        // find which flocks are close enough to interact this tick
+        Flock::FindNearbyFlocks(AllFlocks);
+        // spread the flocks over the threads by how much work they were last tick
+        Scheduler::Plan(AllFlocks);
+        if (NumTicks == 1)
+            Numa::Place(AllFlocks); // (now that every flock has a thread)
+
+        if (VerletList::IsEnabled())
+            VerletList::Update(); // (rebuilds the grid too when needed)
+        else if (SpatialGrid::IsEnabled())
+            SpatialGrid::Rebuild(); // bin all boids into their cells
+
+        if (TaskGraph::IsEnabled())
         {
-            // Rendering is not part of our problem
-            Render();
+            RunTaskGraph();
+        }
+        else
+        {
+            if (!Params.ParallelizeAcrossFlocks)
+                ParallelBoids();
+            else
+                ParallelFlocks();
+            UpdateFlocks();
         }
+        CleanUpFlocks();
 
-        return ElapsedTime.count(); // return wall clock time diff
-    }
+#pragma omp single
+        {
+            std::chrono::duration<double> TickTime = std::chrono::system_clock::now() - TickStart;
+            ElapsedTime += TickTime.count(); // wall clock time diff
+            // save tracer data
+            Tracer::AddTickT(TickTime.count());
+            LastTickAllocs = HeapCounter::NumAllocs() - TickStartAllocs;
+            if (Params.WarmupTicks > 0 && NumTicks > Params.WarmupTicks)
+                SteadyAllocs += LastTickAllocs;
+            // every boid found its next grid cell in Flock::Act (not in per-boid mode)
+            SpatialGrid::SetBinned(Params.ParallelizeAcrossFlocks);
+            if (NLayout::IsDoubleBuffered())
+                NLayout::SwapSoA(); // every boid has written its next state
+            if (NumTicks == 1)
+                FirstTickAllocs = LastTickAllocs;
+        } // implicit barrier
 
-    std::vector<Flock *> GetAllFlocksVector() const
-    {
-        std::vector<Flock *> AllFlocksVec;
-        for (auto It = AllFlocks.begin(); It != AllFlocks.end(); It++)
+        if (Params.RenderingMovie)
         {
-            assert(It != AllFlocks.end());
-            const Flock &F = It->second;
-            Tracer::AddFlockSize(F.Size());
-            AllFlocksVec.push_back(const_cast<Flock *>(&F));
+            // Rendering is not part of our problem
+            if (RenderQueue::IsEnabled())
+                RenderAsync(); // (drawn by the render threads while we keep ticking)
+            else
+                Render();
         }
-        assert(AllFlocksVec.size() == AllFlocks.size());
-        return AllFlocksVec;
     }
 
-    void ParallelBoids(std::vector<Flock *> AllFlocksVec)
+    void ParallelBoids()
     {
         /// NOTE: the following parallel operations are per-boids
-#pragma omp parallel num_threads(Params.NumThreads) // spawns threads
+        if (!GlobalParams.FlockParams.UseLocalNeighbourhoods)
         {
-            if (!GlobalParams.FlockParams.UseLocalNeighbourhoods)
+            std::vector<Boid> &AllBoids = *(AllFlocks[0].Neighbourhood.GetAllBoidsPtr());
+            if (NLayout::IsDoubleBuffered())
             {
-                std::vector<Boid> &AllBoids = *(AllFlocks.begin()->second.Neighbourhood.GetAllBoidsPtr());
+                // (no barrier between planning & acting, see Boid::SenseAndAct)
 #pragma omp for schedule(dynamic)
                 for (size_t i = 0; i < AllBoids.size(); i++)
                 {
-                    AllBoids[i].SenseAndPlan(omp_get_thread_num(), AllFlocks);
+                    AllBoids[i].SenseAndAct(omp_get_thread_num(), AllFlocks, Params.DeltaTime);
                 }
+                return;
+            }
+#pragma omp for schedule(dynamic)
+            for (size_t i = 0; i < AllBoids.size(); i++)
+            {
+                AllBoids[i].SenseAndPlan(omp_get_thread_num(), AllFlocks);
+            }
 #pragma omp barrier
 #pragma omp for schedule(dynamic)
-                for (size_t i = 0; i < AllBoids.size(); i++)
-                {
-                    AllBoids[i].Act(Params.DeltaTime);
-                }
+            for (size_t i = 0; i < AllBoids.size(); i++)
+            {
+                AllBoids[i].Act(Params.DeltaTime);
             }
-            else
+        }
+        else
+        {
+#pragma omp single
             {
-                std::vector<Boid *> AllBoids;
-                for (const Flock *F : AllFlocksVec)
+                // gather every boid once (into one thread's arena), all threads share it
+                LocalBoids = Arena::Alloc<Boid *>(Params.NumBoids);
+                size_t Next = 0;
+                for (const Flock &F : AllFlocks)
                 {
-#pragma omp critical
+                    for (Boid *B : F.Neighbourhood.GetBoids())
                     {
-                        std::vector<Boid *> LocalBoids = F->Neighbourhood.GetBoids();
-                        AllBoids.insert(AllBoids.end(), LocalBoids.begin(), LocalBoids.end());
+                        LocalBoids[Next++] = B;
                     }
                 }
-#pragma omp barrier
-#pragma omp for schedule(dynamic)
-                for (size_t i = 0; i < AllBoids.size(); i++)
-                {
-                    AllBoids[i]->SenseAndPlan(omp_get_thread_num(), AllFlocks);
-                }
-#pragma omp barrier
+                assert(Next == Params.NumBoids);
+            } // implicit barrier
+            if (NLayout::IsDoubleBuffered())
+            {
 #pragma omp for schedule(dynamic)
-                for (size_t i = 0; i < AllBoids.size(); i++)
+                for (size_t i = 0; i < Params.NumBoids; i++)
                 {
-                    AllBoids[i]->Act(Params.DeltaTime);
+                    LocalBoids[i]->SenseAndAct(omp_get_thread_num(), AllFlocks, Params.DeltaTime);
                 }
+                return;
             }
-        }
-    }
-
-    void ParallelFlocks(std::vector<Flock *> AllFlocksVec)
-    {
-#pragma omp parallel num_threads(Params.NumThreads) // spawns threads
-        {
-            // parallelizing across flocks
 #pragma omp for schedule(dynamic)
-            for (size_t i = 0; i < AllFlocksVec.size(); i++)
+            for (size_t i = 0; i < Params.NumBoids; i++)
             {
-                AllFlocksVec[i]->SenseAndPlan(omp_get_thread_num(), AllFlocks);
+                LocalBoids[i]->SenseAndPlan(omp_get_thread_num(), AllFlocks);
             }
 #pragma omp barrier
 #pragma omp for schedule(dynamic)
-            for (size_t i = 0; i < AllFlocksVec.size(); i++)
+            for (size_t i = 0; i < Params.NumBoids; i++)
             {
-                AllFlocksVec[i]->Act(Params.DeltaTime);
+                LocalBoids[i]->Act(Params.DeltaTime);
             }
         }
     }
 
-    void UpdateFlocks(std::vector<Flock *> AllFlocksVec)
+    void ParallelFlocks()
     {
-#pragma omp parallel num_threads(Params.NumThreads) // spawns threads
+        // parallelizing across flocks (balanced by their cost if work stealing)
+        if (NLayout::IsDoubleBuffered())
         {
-            if (GlobalParams.FlockParams.UseFlocks)
-            {
-                /// NOTE: the following parallel operations are per-flocks, not per-boids
-#pragma omp for schedule(dynamic)
-                for (size_t i = 0; i < AllFlocksVec.size(); i++)
-                {
-                    AllFlocksVec[i]->Delegate(omp_get_thread_num(), AllFlocksVec);
-                }
-#pragma omp barrier
-#pragma omp for schedule(dynamic)
-                for (size_t i = 0; i < AllFlocksVec.size(); i++)
-                {
-                    AllFlocksVec[i]->AssignToFlock(omp_get_thread_num());
-                }
-            }
-#pragma omp barrier
-#pragma omp for schedule(dynamic)
-            for (size_t i = 0; i < AllFlocksVec.size(); i++)
+            Scheduler::ForEach(AllFlocks.Size(), [this](const size_t i) {
+                AllFlocks[i].SenseAndAct(omp_get_thread_num(), AllFlocks, Params.DeltaTime);
+            });
+            return;
+        }
+        Scheduler::ForEach(AllFlocks.Size(), [this](const size_t i) {
+            AllFlocks[i].SenseAndPlan(omp_get_thread_num(), AllFlocks);
+        }); // (ends with a barrier)
+        Scheduler::ForEach(AllFlocks.Size(), [this](const size_t i) { AllFlocks[i].Act(Params.DeltaTime); });
+    }
+
+    void UpdateFlocks()
+    {
+        if (GlobalParams.FlockParams.UseFlocks)
+        {
+            /// NOTE: the following parallel operations are per-flocks, not per-boids
+            Scheduler::ForEach(AllFlocks.Size(),
+                               [this](const size_t i) { AllFlocks[i].Delegate(omp_get_thread_num()); });
+            Scheduler::ForEach(AllFlocks.Size(), [this](const size_t i) { AllFlocks[i].ReserveImmigrants(); });
+            Scheduler::ForEach(AllFlocks.Size(),
+                               [this](const size_t i) { AllFlocks[i].AssignToFlock(omp_get_thread_num()); });
+            if (NLayout::GetType() == NLayout::Global)
             {
-                AllFlocksVec[i]->ComputeBB();
+                // global migrations only changed the boids' owners, so regroup them by flock
+                NLayout::RebuildMembership();
             }
+            Scheduler::ForEach(AllFlocks.Size(), [this](const size_t i) { AllFlocks[i].RemoveEmigrants(); });
         }
-        // convert flock data to processor communications
-        Tracer::SaveFlockMatrix(AllFlocks);
-        // compute avg flock size
-        Tracer::ComputeFlockAverageSize();
-        // remove empty (invalid) flocks
-        Flock::CleanUp(AllFlocks);
+        Scheduler::ForEach(AllFlocks.Size(), [this](const size_t i) { AllFlocks[i].ComputeBB(); });
     }
 
-    void Render()
+    void RunTaskGraph()
     {
-        // draw all the boids onto the frame
-        std::vector<Flock *> AllFlocksVec;
-        for (auto It = AllFlocks.begin(); It != AllFlocks.end(); It++)
+        /// NOTE: the same phases as ParallelBoids/ParallelFlocks + UpdateFlocks, but
+        // with the barriers between them replaced by per-flock dependencies
+        TaskGraph::Phase First = TaskGraph::SenseAndPlan;
+        if (!Params.ParallelizeAcrossFlocks)
+        {
+            ParallelBoids(); // (per-boid phases have no flock to depend on)
+            First = TaskGraph::Delegate;
+        }
+        else if (VerletList::IsEnabled() && !NLayout::IsDoubleBuffered())
         {
-            assert(It != AllFlocks.end());
-            Flock &F = It->second;
-            AllFlocksVec.push_back(&F);
+            // the neighbour lists reach past the nearby flocks, so nobody can act
+            // until every flock is done sensing
+            TaskGraph::Run(AllFlocks, TaskGraph::SenseAndPlan, TaskGraph::SenseAndPlan);
+            First = TaskGraph::Act;
         }
-#pragma omp parallel for num_threads(Params.NumThreads) schedule(dynamic)
-        for (size_t i = 0; i < AllFlocksVec.size(); i++)
+        if (GlobalParams.FlockParams.UseFlocks && NLayout::GetType() == NLayout::Global)
         {
-            AllFlocksVec[i]->Draw(I);
+            TaskGraph::Run(AllFlocks, First, TaskGraph::AssignToFlock);
+            // global migrations only changed the boids' owners, so regroup them by flock
+            NLayout::RebuildMembership();
+            TaskGraph::Run(AllFlocks, TaskGraph::RemoveEmigrants, TaskGraph::ComputeBB);
         }
-        // draw the target onto the frame
-        I.ExportPPMImage();
-        I.Blank();
+        else
+        {
+            TaskGraph::Run(AllFlocks, First, TaskGraph::ComputeBB);
+        }
+    }
+
+    void CleanUpFlocks()
+    {
+#pragma omp single
+        {
+            // convert flock data to processor communications
+            Tracer::SaveFlockMatrix(AllFlocks);
+            // how many of the boid reads were from the readers' own NUMA node
+            Tracer::AddNodeLocality(AllFlocks);
+            // compute avg flock size
+            Tracer::ComputeFlockAverageSize();
+        } // implicit barrier
+        // remove empty (invalid) flocks
+        Flock::CleanUp(AllFlocks);
+    }
+
+    void Snapshot(RenderQueue::Frame &F)
+    {
+        size_t *Offsets = nullptr; // where each flock's boids go in the frame
+#pragma omp single copyprivate(Offsets)
+        {
+            const size_t N = AllFlocks.Size();
+            Offsets = Arena::Alloc<size_t>(N + 1);
+            Offsets[0] = 0;
+            for (size_t i = 0; i < N; i++)
+            {
+                Offsets[i + 1] = Offsets[i] + AllFlocks[i].Size(); // prefix sum
+            }
+            F.Boids.resize(Offsets[N]);
+            F.Boxes.resize(GlobalParams.ImageParams.RenderBB ? N : 0);
+        } // implicit barrier
+#pragma omp for schedule(static)
+        for (size_t i = 0; i < AllFlocks.Size(); i++)
+        {
+            AllFlocks[i].Snapshot(F, Offsets[i], i);
+        } // implicit barrier
+    }
+
+    void RenderAsync()
+    {
+        RenderQueue::Frame *F = nullptr;
+#pragma omp single copyprivate(F)
+        F = RenderQueue::Acquire(); // (blocks while the render threads are behind)
+        Snapshot(*F);
+#pragma omp single nowait
+        RenderQueue::Submit(F);
+    }
+
+    void Render()
+    {
+        /// NOTE: the boids are snapshot first, so the frame can be drawn tile by tile
+        // (every thread owning whole tiles) instead of every thread drawing its flocks
+        // straight into the shared image
+        Snapshot(Frame);
+        Raster.Draw(Frame, I); // (which also clears the last frame)
+#pragma omp single
+        {
+            // draw the target onto the frame
+            I.ExportPPMImage();
+        } // implicit barrier
     }
 };
 
@@ -259,14 +448,15 @@ TracerParamsStruct Tracer::Params;
 // global params struct
 ParamsStruct GlobalParams;
 
-void RunSimulation()
+bool RunSimulation()
 {
     Tracer::Initialize();
     Simulator Sim;
-    Sim.Simulate();
+    const bool Steady = Sim.Simulate();
     // Dump all tracer data
     Tracer::Dump();
     Sim.Finish();
+    return Steady;
 }
 
 int main(int argc, char *argv[])
@@ -281,10 +471,11 @@ int main(int argc, char *argv[])
         const std::string ParamFile(argv[1]);
         ParseParams("params/" + ParamFile);
     }
+    bool Steady = true;
     if (GlobalParams.SimulatorParams.NumThreads > 0)
     {
         // specify a legal thread amnt
-        RunSimulation();
+        Steady = RunSimulation();
     }
     else
     {
@@ -294,11 +485,11 @@ int main(int argc, char *argv[])
         {
             // overwrite NumThreads
             GlobalParams.SimulatorParams.NumThreads = P;
-            RunSimulation();
+            Steady &= RunSimulation();
             std::cout << std::endl;
         }
     }
-    return 0;
+    return Steady ? 0 : 1; // (non-zero if a steady-state tick allocated)
 }
 
 /// PSEUDOCODE: http://www.vergenet.net/~conrad/boids/pseudocode.html
@@ -0,0 +1,123 @@
+#include "TaskGraph.hpp"
+#include "Arena.hpp" // dependency counters
+#include <omp.h>     // OpenMP
+
+// declaring static variables
+FlockMap *TaskGraph::Flocks = nullptr;
+TaskGraph::Phase TaskGraph::RunFirst;
+TaskGraph::Phase TaskGraph::RunLast;
+int *TaskGraph::Pending = nullptr;
+
+bool TaskGraph::IsEnabled()
+{
+    return GlobalParams.SimulatorParams.UseDataflow;
+}
+
+void TaskGraph::Run(FlockMap &AllFlocks, const Phase First, const Phase Last)
+{
+    /// NOTE: every phase of a flock only reads (or writes) the boids of its nearby
+    // flocks, and NearbyFlocks is symmetric (and includes the flock itself), so once
+    // all of them are done with a phase the flock can safely start the next one
+    assert(First <= Last);
+    const size_t N = AllFlocks.Size();
+    const size_t NumSteps = Last - First;
+#pragma omp single
+    {
+        Flocks = &AllFlocks;
+        RunFirst = First;
+        RunLast = Last;
+        Pending = Arena::Alloc<int>(NumSteps * N);
+    } // implicit barrier
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        for (size_t s = 0; s < NumSteps; s++)
+        {
+            Pending[s * N + i] = int(AllFlocks[i].NumNearby);
+        }
+    } // implicit barrier
+#pragma omp for schedule(dynamic)
+    for (size_t i = 0; i < N; i++)
+    {
+        Execute(i, First);
+    } // implicit barrier (which also waits for every task spawned along the way)
+}
+
+void TaskGraph::RunPhase(Flock &F, const Phase P)
+{
+    const int TID = omp_get_thread_num();
+    const bool UseFlocks = GlobalParams.FlockParams.UseFlocks;
+    switch (P)
+    {
+    case SenseAndPlan:
+        if (NLayout::IsDoubleBuffered())
+            F.SenseAndAct(TID, *Flocks, GlobalParams.SimulatorParams.DeltaTime);
+        else
+            F.SenseAndPlan(TID, *Flocks);
+        break;
+    case Act:
+        if (!NLayout::IsDoubleBuffered())
+            F.Act(GlobalParams.SimulatorParams.DeltaTime);
+        break;
+    case Delegate:
+        if (UseFlocks)
+            F.Delegate(TID);
+        break;
+    case ReserveImmigrants:
+        if (UseFlocks)
+            F.ReserveImmigrants();
+        break;
+    case AssignToFlock:
+        if (UseFlocks)
+            F.AssignToFlock(TID);
+        break;
+    case RemoveEmigrants:
+        if (UseFlocks)
+            F.RemoveEmigrants();
+        break;
+    case ComputeBB:
+        F.ComputeBB();
+        break;
+    }
+}
+
+void TaskGraph::Execute(size_t Idx, Phase P)
+{
+    const size_t N = Flocks->Size();
+    const size_t None = N;
+    while (true)
+    {
+        Flock &F = (*Flocks)[Idx];
+        RunPhase(F, P);
+        if (P == RunLast)
+            return;
+        // this flock is done with P, so release its nearby flocks (including itself)
+        // into their next phase, continuing with the first one that becomes ready
+        const Phase Next = Phase(P + 1);
+        int *NextPending = &Pending[(Next - RunFirst - 1) * N];
+        size_t Continue = None;
+        for (size_t n = 0; n < F.NumNearby; n++)
+        {
+            const Flock *G = F.NearbyFlocks[n];
+            const size_t GIdx = Flocks->IndexOf(G);
+            int Left;
+            /// NOTE: seq_cst so that the thread that releases a flock also sees
+            // everything the other nearby flocks wrote before releasing it
+#pragma omp atomic capture seq_cst
+            Left = --NextPending[GIdx];
+            if (Left > 0)
+                continue;
+            if (Continue == None)
+            {
+                Continue = GIdx; // (runs on this thread, while the data is still warm)
+                continue;
+            }
+#pragma omp task firstprivate(GIdx, Next)
+            Execute(GIdx, Next);
+        }
+        if (Continue == None)
+            return;
+        Idx = Continue;
+        P = Next;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef TASKGRAPH
+#define TASKGRAPH
+
+#include "FlockMap.hpp" // FlockMap
+#include "Utils.hpp"    // Params
+
+class TaskGraph // dataflow scheduling of the per-flock phases of a tick
+{
+  public:
+    // the per-flock phases of a tick (in order)
+    enum Phase
+    {
+        SenseAndPlan,
+        Act,
+        Delegate,
+        ReserveImmigrants,
+        AssignToFlock,
+        RemoveEmigrants,
+        ComputeBB
+    };
+    static bool IsEnabled();
+    // runs phases First..Last of every flock, where a flock starts a phase as soon as
+    // all its nearby flocks finished the previous one (instead of all flocks waiting at
+    // a barrier), must be called by every thread of the tick's parallel region
+    static void Run(FlockMap &AllFlocks, const Phase First, const Phase Last);
+
+  private:
+    // runs phase P of the flock at Idx, then (keeps) running whatever that released
+    static void Execute(size_t Idx, Phase P);
+    static void RunPhase(Flock &F, const Phase P);
+    static FlockMap *Flocks;
+    static Phase RunFirst, RunLast;
+    // Pending[(P - RunFirst - 1) * NumFlocks + Idx] is how many of the nearby flocks of
+    // the flock at Idx have not finished phase P - 1 yet
+    static int *Pending;
+};
+
+#endif
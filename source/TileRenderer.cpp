@@ -0,0 +1,154 @@
+#include "TileRenderer.hpp"
+#include "Boid.hpp"  // drawing the boids
+#include <algorithm> // std::min, std::max
+#include <cassert>
+#include <cmath> // std::floor
+#include <omp.h> // OpenMP
+
+bool TileRenderer::IsTiled()
+{
+    return GlobalParams.ImageParams.RenderTileSize > 0;
+}
+
+size_t TileRenderer::NumPrimitives(const RenderQueue::Frame &F) const
+{
+    return 4 * F.Boxes.size() + F.Boids.size();
+}
+
+void TileRenderer::EdgeOf(const RenderQueue::Rect &Box, const size_t Edge, Vec2D &A, Vec2D &B)
+{
+    const Vec2D TopLeft(Box.TLX, Box.TLY);
+    const Vec2D TopRight(Box.BRX, Box.TLY);
+    const Vec2D BottomLeft(Box.TLX, Box.BRY);
+    const Vec2D BottomRight(Box.BRX, Box.BRY);
+    assert(Edge < 4);
+    A = (Edge < 2) ? TopLeft : BottomRight;
+    B = (Edge % 2 == 0) ? TopRight : BottomLeft;
+}
+
+bool TileRenderer::TilesOf(const RenderQueue::Frame &F, const size_t P, size_t &TX0, size_t &TY0, size_t &TX1,
+                           size_t &TY1) const
+{
+    Vec2D A, B;
+    float Extent;
+    if (P < 4 * F.Boxes.size())
+    {
+        EdgeOf(F.Boxes[P / 4], P % 4, A, B);
+        Extent = 1; // (pixels are truncated)
+    }
+    else
+    {
+        const RenderQueue::Sprite &S = F.Boids[P - 4 * F.Boxes.size()];
+        A = Vec2D(S.X, S.Y);
+        B = A;
+        // the circle & the heading line (2 radii long) in front of it
+        Extent = 2 * GlobalParams.BoidParams.Radius + 1;
+    }
+    const float X0 = std::min(A[0], B[0]) - Extent, X1 = std::max(A[0], B[0]) + Extent;
+    const float Y0 = std::min(A[1], B[1]) - Extent, Y1 = std::max(A[1], B[1]) + Extent;
+    if (!(X1 >= 0 && Y1 >= 0 && X0 < Image::Params.WindowX && Y0 < Image::Params.WindowY))
+        return false; // (also skips NaNs)
+    TX0 = size_t(std::max(X0, 0.f)) / TileSize;
+    TY0 = size_t(std::max(Y0, 0.f)) / TileSize;
+    TX1 = std::min(size_t(X1) / TileSize, NumTilesX - 1);
+    TY1 = std::min(size_t(Y1) / TileSize, NumTilesY - 1);
+    return true;
+}
+
+void TileRenderer::DrawPrimitive(const RenderQueue::Frame &F, const size_t P, Image &I, const Image::Clip &R) const
+{
+    if (P < 4 * F.Boxes.size())
+    {
+        Vec2D A, B;
+        EdgeOf(F.Boxes[P / 4], P % 4, A, B);
+        I.DrawLine(A, B, Colour(255, 0, 0), R);
+    }
+    else
+    {
+        const RenderQueue::Sprite &S = F.Boids[P - 4 * F.Boxes.size()];
+        Boid::Draw(I, Vec2D(S.X, S.Y), Vec2D(S.VX, S.VY), S.C, R);
+    }
+}
+
+void TileRenderer::Draw(const RenderQueue::Frame &F, Image &I)
+{
+    /// WARNING: this must be called by every thread of the parallel region (if any)
+    const size_t NumThreads = omp_get_num_threads();
+    const size_t TID = omp_get_thread_num();
+    const size_t N = NumPrimitives(F);
+#pragma omp single
+    {
+        // (0 draws the whole window as one tile)
+        const size_t WindowSize = std::max(Image::Params.WindowX, Image::Params.WindowY);
+        TileSize = IsTiled() ? GlobalParams.ImageParams.RenderTileSize : std::max(WindowSize, size_t(1));
+        NumTilesX = std::max(size_t(1), (Image::Params.WindowX + TileSize - 1) / TileSize);
+        NumTilesY = std::max(size_t(1), (Image::Params.WindowY + TileSize - 1) / TileSize);
+        Counts.assign(NumThreads * NumTilesX * NumTilesY, 0);
+    } // implicit barrier
+    const size_t NumTiles = NumTilesX * NumTilesY;
+    size_t *MyCounts = Counts.data() + TID * NumTiles;
+    // first count how many primitives each thread bins into each tile
+    /// NOTE: a static schedule hands every thread the same (contiguous, ordered) chunk
+    // in both binning loops, so each tile's primitives stay in the frame's order
+#pragma omp for schedule(static)
+    for (size_t p = 0; p < N; p++)
+    {
+        size_t TX0, TY0, TX1, TY1;
+        if (!TilesOf(F, p, TX0, TY0, TX1, TY1))
+            continue;
+        for (size_t ty = TY0; ty <= TY1; ty++)
+        {
+            for (size_t tx = TX0; tx <= TX1; tx++)
+            {
+                MyCounts[tx + ty * NumTilesX]++;
+            }
+        }
+    } // implicit barrier
+#pragma omp single
+    {
+        TileStart.resize(NumTiles + 1);
+        size_t Next = 0;
+        for (size_t k = 0; k < NumTiles; k++)
+        {
+            TileStart[k] = Next;
+            for (size_t t = 0; t < NumThreads; t++)
+            {
+                const size_t Count = Counts[t * NumTiles + k];
+                Counts[t * NumTiles + k] = Next; // prefix sum (tile-major, then by thread)
+                Next += Count;
+            }
+        }
+        TileStart[NumTiles] = Next;
+        Binned.resize(Next);
+    } // implicit barrier
+    // then fill them in
+#pragma omp for schedule(static)
+    for (size_t p = 0; p < N; p++)
+    {
+        size_t TX0, TY0, TX1, TY1;
+        if (!TilesOf(F, p, TX0, TY0, TX1, TY1))
+            continue;
+        for (size_t ty = TY0; ty <= TY1; ty++)
+        {
+            for (size_t tx = TX0; tx <= TX1; tx++)
+            {
+                Binned[MyCounts[tx + ty * NumTilesX]++] = p;
+            }
+        }
+    } // implicit barrier
+    // every tile is cleared & drawn by whichever thread picks it up
+#pragma omp for schedule(dynamic)
+    for (size_t k = 0; k < NumTiles; k++)
+    {
+        Image::Clip R;
+        R.X0 = (k % NumTilesX) * TileSize;
+        R.Y0 = (k / NumTilesX) * TileSize;
+        R.X1 = std::min(R.X0 + TileSize, Image::Params.WindowX);
+        R.Y1 = std::min(R.Y0 + TileSize, Image::Params.WindowY);
+        I.Blank(R);
+        for (size_t b = TileStart[k]; b < TileStart[k + 1]; b++)
+        {
+            DrawPrimitive(F, Binned[b], I, R);
+        }
+    } // implicit barrier
+}
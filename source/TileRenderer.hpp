@@ -0,0 +1,39 @@
+#ifndef TILE_RENDERER
+#define TILE_RENDERER
+
+#include "Image.hpp"       // Image
+#include "RenderQueue.hpp" // RenderQueue::Frame
+#include "Utils.hpp"       // Params
+#include <vector>          // std::vector
+
+class TileRenderer // rasterizes a frame snapshot into screen tiles, every thread owning whole tiles
+{
+  public:
+    /// NOTE: every box edge & boid of the frame is binned into the tiles it can touch,
+    // then each tile is cleared & drawn (clipped to itself) by the one thread that owns
+    // it, so no two threads ever write the same pixels (or share a cache line but at
+    // the tiles' vertical edges). Within a tile everything is drawn in the frame's
+    // order (every box, then every boid), so the image doesn't depend on the threads
+    static bool IsTiled();
+    // clear I & draw F onto it (called by every thread of a parallel region, or by a
+    // lone thread such as a render thread)
+    void Draw(const RenderQueue::Frame &F, Image &I);
+
+  private:
+    // the primitives are the 4 edges of every box (in DrawStrokedRect's order) & then
+    // every boid
+    size_t NumPrimitives(const RenderQueue::Frame &F) const;
+    // the tiles [TX0, TX1] x [TY0, TY1] that primitive P can draw into (false if none)
+    static void EdgeOf(const RenderQueue::Rect &Box, const size_t Edge, Vec2D &A, Vec2D &B);
+    bool TilesOf(const RenderQueue::Frame &F, const size_t P, size_t &TX0, size_t &TY0, size_t &TX1,
+                 size_t &TY1) const;
+    void DrawPrimitive(const RenderQueue::Frame &F, const size_t P, Image &I, const Image::Clip &R) const;
+    size_t TileSize = 0, NumTilesX = 1, NumTilesY = 1;
+    // Counts[t * NumTiles + k] is how many primitives thread t binned into tile k, then
+    // (after the prefix sum) where the next of them goes in Binned
+    std::vector<size_t> Counts;
+    // TileStart[k] is the first index of tile k's primitives in Binned (CSR style)
+    std::vector<size_t> TileStart, Binned;
+};
+
+#endif
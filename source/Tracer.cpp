@@ -1,8 +1,14 @@
 #include "Tracer.hpp"
+#include "Numa.hpp"
 #include <algorithm>
 #include <cassert>
 #include <iostream>
 
+#ifndef NTRACE
+// shared by the threads adding the storage locality (a static member can't be reduced)
+static double LocalitySum = 0;
+#endif
+
 void Tracer::Initialize()
 {
 #ifndef NTRACE
@@ -29,7 +35,7 @@ void Tracer::InitFlockMatrix(const size_t NumFlocks)
 #endif
 }
 
-void Tracer::SaveFlockMatrix(const std::unordered_map<size_t, Flock> &AllFlocks)
+void Tracer::SaveFlockMatrix(const FlockMap &AllFlocks)
 {
 #ifndef NTRACE
     if (!Params.TrackMem)
@@ -38,20 +44,20 @@ void Tracer::SaveFlockMatrix(const std::unordered_map<size_t, Flock> &AllFlocks)
     assert(T->CommunicationMatrix.size() > 0);
     for (size_t FID = 0; FID < T->CommunicationMatrix.size(); FID++)
     {
-        auto It = AllFlocks.find(FID);
-        assert(It != AllFlocks.end());
-        const Flock &F = It->second;
+        const Flock *F = AllFlocks.Find(FID);
+        if (F == nullptr)
+            continue; // flock was removed in an earlier tick (so has no ops)
         // for FID being the requestor flock ID
         for (size_t FID2 = 0; FID2 < T->CommunicationMatrix[FID].size(); FID2++)
         {
-            auto It2 = AllFlocks.find(FID2);
-            assert(It2 != AllFlocks.end());
-            const Flock &F2 = It2->second;
+            const Flock *F2 = AllFlocks.Find(FID2);
+            if (F2 == nullptr)
+                continue;
             // for FID2 being the holder flock ID
             FlockOps &FO = T->CommunicationMatrix[FID][FID2];
             /// NOTE: assigning thread ID's can only be done AFTER all ops have completed
-            FO.RequestorTIDs = F.TIDs;
-            FO.HolderTIDs = F2.TIDs;
+            FO.RequestorTIDs = F->TIDs;
+            FO.HolderTIDs = F2->TIDs;
             Tracer::AddFlockOps(FO);
         }
     }
@@ -169,22 +175,118 @@ void Tracer::ComputeFlockAverageSize()
 #endif
 }
 
+void Tracer::AddReorderT(const double ElapsedTime)
+{
+    if (!Params.TrackLocality)
+        return; // do nothing
+#ifndef NTRACE
+    Tracer *T = Instance();
+    T->ReorderTimes.push_back(ElapsedTime);
+#else
+    (void)0;
+#endif
+}
+
+void Tracer::AddStorageLocality(const BoidSoA &S)
+{
+    if (!Params.TrackLocality)
+        return; // do nothing
+#ifndef NTRACE
+    /// NOTE: this is small when boids that are next to each other in memory are
+    // also next to each other in the world (ie. neighbour reads hit the same lines)
+    /// WARNING: this must be called by every thread of the tick's parallel region
+#pragma omp single
+    LocalitySum = 0; // implicit barrier
+#pragma omp for schedule(static) reduction(+ : LocalitySum)
+    for (size_t i = 1; i < S.Size(); i++)
+    {
+        LocalitySum += Vec2D(S.X[i] - S.X[i - 1], S.Y[i] - S.Y[i - 1]).Size();
+    } // implicit barrier
+#pragma omp single nowait
+    Instance()->StorageLocality.push_back((S.Size() > 1) ? LocalitySum / (S.Size() - 1) : LocalitySum);
+#else
+    (void)0;
+#endif
+}
+
+void Tracer::AddNodeLocality(const FlockMap &AllFlocks)
+{
+    if (!Params.TrackLocality)
+        return; // do nothing
+#ifndef NTRACE
+    Tracer *T = Instance();
+    /// NOTE: every interaction reads the hot state of one boid of a nearby flock (incl.
+    // ourselves), so a flock's interactions are spread evenly over the SoA lines of all
+    // the boids it could have sensed, charged to the pages those lines are on
+    const BoidSoA &S = NLayout::GetSoA();
+    const size_t BytesPerBoid = 4 * sizeof(float) + 2 * sizeof(size_t);
+    const size_t PageFloats = Numa::PageSize() / sizeof(float);
+    const size_t NumPages = (S.Size() + PageFloats - 1) / PageFloats;
+    std::vector<int> PageNodes(NumPages);
+    Numa::PageNodes(S.X.data(), NumPages, PageNodes.data());
+    T->NodeReads.resize(std::max(T->NodeReads.size(), Numa::NumNodes()));
+    for (const Flock &F : AllFlocks)
+    {
+        if (F.TIDs.SenseAndPlan < 0)
+            continue;
+        size_t NumCandidates = 0;
+        for (size_t n = 0; n < F.NumNearby; n++)
+        {
+            NumCandidates += F.NearbyFlocks[n]->Size();
+        }
+        if (NumCandidates == 0)
+            continue;
+        const int Node = Numa::NodeOf(F.TIDs.SenseAndPlan);
+        const double BytesPerRead = double(F.Interactions) * BytesPerBoid / NumCandidates;
+        for (size_t n = 0; n < F.NumNearby; n++)
+        {
+            const Flock *Other = F.NearbyFlocks[n];
+            const size_t *BoidIDs = Other->Neighbourhood.GetBoidIDs();
+            for (size_t b = 0; b < Other->Size(); b++)
+            {
+                if (PageNodes[BoidIDs[b] / PageFloats] == Node)
+                    T->NodeReads[Node].LocalBytes += BytesPerRead;
+                else
+                    T->NodeReads[Node].RemoteBytes += BytesPerRead;
+            }
+        }
+    }
+#else
+    (void)0;
+#endif
+}
+
 void Tracer::Dump()
 {
 #ifndef NTRACE
     Tracer *T = Instance();
+    double TotalTime = 0; // (of the tick timings, if they were tracked)
+    for (const double t : T->TickTimes)
+    {
+        TotalTime += t;
+    }
     if (Params.TrackMem)
     {
         std::cout << "Comms Matrix:" << std::endl;
-        for (const std::vector<MemoryOps> &MemoryRow : T->MemoryOpMatrix)
+        size_t TotalReads = 0, CrossReads = 0; // (off the diagonal)
+        for (size_t i = 0; i < T->MemoryOpMatrix.size(); i++)
         {
             std::cout << "[ ";
-            for (const MemoryOps &M : MemoryRow)
+            for (size_t j = 0; j < T->MemoryOpMatrix[i].size(); j++)
             {
+                const MemoryOps &M = T->MemoryOpMatrix[i][j];
                 std::cout << M.Reads << ", ";
+                TotalReads += M.Reads;
+                if (i != j)
+                    CrossReads += M.Reads;
             }
             std::cout << "]" << std::endl;
         }
+        if (TotalReads > 0)
+        {
+            std::cout << "Cross-thread reads: " << CrossReads << " of " << TotalReads << " ("
+                      << 100.0 * CrossReads / TotalReads << "%)" << std::endl;
+        }
         T->MemoryOpMatrix.clear();
     }
     if (Params.TrackTickT)
@@ -207,6 +309,34 @@ void Tracer::Dump()
         std::cout << "]" << std::endl;
         T->AvgFlockSizes.clear();
     }
+    if (Params.TrackLocality)
+    {
+        for (size_t n = 0; n < T->NodeReads.size(); n++)
+        {
+            const NodeOps &R = T->NodeReads[n];
+            const double Total = R.LocalBytes + R.RemoteBytes;
+            std::cout << "NUMA node " << n << ": " << Total / 1e6 << "MB of boids sensed, "
+                      << ((Total > 0) ? 100.0 * R.LocalBytes / Total : 0) << "% local";
+            if (TotalTime > 0)
+                std::cout << " (" << Total / 1e6 / TotalTime << "MB/s)";
+            std::cout << std::endl;
+        }
+        T->NodeReads.clear();
+        std::cout << "Reorder Timings" << std::endl << "[";
+        for (const double t : T->ReorderTimes)
+        {
+            std::cout << t << ", ";
+        }
+        std::cout << "]" << std::endl;
+        T->ReorderTimes.clear();
+        std::cout << "Storage Locality" << std::endl << "[";
+        for (const double l : T->StorageLocality)
+        {
+            std::cout << l << ", ";
+        }
+        std::cout << "]" << std::endl;
+        T->StorageLocality.clear();
+    }
 #else
     std::cout << "Trace not executing (compiled with -DNTRACE)" << std::endl;
 #endif
@@ -2,6 +2,7 @@
 #define TRACER
 
 #include "Flock.hpp"
+#include "FlockMap.hpp"
 #include "Utils.hpp"
 #include <omp.h>
 #include <vector>
@@ -11,7 +12,7 @@ class Tracer
   public:
     static void Initialize();
     static void InitFlockMatrix(const size_t NumFlocks);
-    static void SaveFlockMatrix(const std::unordered_map<size_t, Flock> &AllFlocks);
+    static void SaveFlockMatrix(const FlockMap &AllFlocks);
     // incrementors for reads/writes
     // static void AddWrite(const size_t F_Requestor, const size_t F_Holder, const Flock::FlockOp F);
     static void AddRead(const size_t F_Requestor, const size_t F_Holder, const Flock::FlockOp F);
@@ -21,6 +22,13 @@ class Tracer
     static void AddFlockSize(const size_t FS);
     // compute avg
     static void ComputeFlockAverageSize();
+    // incrementors for (Morton) reordering time
+    static void AddReorderT(const double ElapsedTime);
+    // avg distance between boids that are adjacent in memory
+    // (called by every thread of the tick's parallel region)
+    static void AddStorageLocality(const BoidSoA &S);
+    // bytes of boid state sensed this tick from (vs outside) the sensing thread's node
+    static void AddNodeLocality(const FlockMap &AllFlocks);
     // print everything to stdout
     static void Dump();
 
@@ -45,6 +53,11 @@ class Tracer
         // size_t Writes = 0;
     };
     std::vector<std::vector<MemoryOps>> MemoryOpMatrix;
+    struct NodeOps
+    {
+        double LocalBytes = 0, RemoteBytes = 0;
+    };
+    std::vector<NodeOps> NodeReads; // (indexed by the node of the reading thread)
 
     struct FlockOps
     {
@@ -58,6 +71,8 @@ class Tracer
     std::vector<double> TickTimes;
     std::vector<double> AvgFlockSizes;
     std::vector<size_t> TmpFlockSizes;
+    std::vector<double> ReorderTimes;
+    std::vector<double> StorageLocality;
 };
 
 #endif
\ No newline at end of file
@@ -1,11 +1,15 @@
 #ifndef UTILS
 #define UTILS
 
+#include "HeapCounter.hpp" // counting our allocations
 #include <cassert>
 #include <cmath> // pow
 #include <cstdio>
+#include <cstdlib> // posix_memalign
 #include <fstream>
 #include <iostream>
+#include <new> // std::bad_alloc
+#include <utility> // std::forward
 #include <vector>
 
 inline float sqr(const float a)
@@ -26,6 +30,53 @@ inline bool stob(const std::string &s)
     return (s.at(0) == 't');
 }
 
+//////////// :MEMORY: //////////////
+
+template <typename T> struct AlignedAllocator
+{
+    // allocator that starts every buffer on a cache line (for streaming/SIMD access)
+    typedef T value_type;
+    static const size_t Alignment = 64;
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U> &)
+    {
+    }
+    // default-initialize (so trivial values are left untouched), which lets the pages
+    // of a freshly resized buffer be first touched by whichever thread writes them
+    template <typename U> void construct(U *Ptr)
+    {
+        ::new (static_cast<void *>(Ptr)) U;
+    }
+    template <typename U, typename... Args> void construct(U *Ptr, Args &&... A)
+    {
+        ::new (static_cast<void *>(Ptr)) U(std::forward<Args>(A)...);
+    }
+    T *allocate(const size_t N)
+    {
+        void *Ptr = nullptr;
+        if (posix_memalign(&Ptr, Alignment, N * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        HeapCounter::Count();
+        return static_cast<T *>(Ptr);
+    }
+    void deallocate(T *Ptr, const size_t)
+    {
+        free(Ptr);
+    }
+};
+
+template <typename T, typename U> bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &)
+{
+    return true; // stateless
+}
+
+template <typename T, typename U> bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &)
+{
+    return false; // stateless
+}
+
+template <typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
 //////////// :PARAMS: //////////////
 
 struct BoidParamsStruct
@@ -33,22 +84,26 @@ struct BoidParamsStruct
     float Cohesion, Alignment, Separation;
     float MaxVel, Radius;
     float NeighbourhoodRadius, CollisionRadius;
-    bool ColourByThread;
+    float VerletSkin;
+    bool ColourByThread, UseSIMD, DoubleBuffer;
 };
 
 struct SimulatorParamsStruct
 {
     int NumThreads;
     size_t NumBoids, NumIterations;
+    size_t WarmupTicks; // (Simulator only)
     float DeltaTime;
-    bool ParallelizeAcrossFlocks, RenderingMovie;
+    bool ParallelizeAcrossFlocks, RenderingMovie, UseDataflow, UseWorkStealing, UseAffinity, UseNuma;
+    bool WeakScaling; // (MpiSimulator only)
+    float AffinityImbalance;
 };
 
 struct FlockParamsStruct
 {
-    bool UseFlocks;
+    bool UseFlocks, UseSpatialGrid;
     int MaxSize;
-    size_t MaxNumComm, UseLocalNeighbourhoods;
+    size_t MaxNumComm, UseLocalNeighbourhoods, ReorderInterval, SplitSize;
     float WeightFlockSize, WeightFlockDist;
 };
 
@@ -56,11 +111,13 @@ struct ImageParamsStruct
 {
     size_t WindowX, WindowY;
     bool RenderBB;
+    size_t RenderQueue, RenderThreads; // (frame buffers & threads to render asynchronously)
+    size_t RenderTileSize;             // (pixels per side of the tiles a frame is drawn in)
 };
 
 struct TracerParamsStruct
 {
-    bool TrackMem, TrackTickT, TrackFlockSizes;
+    bool TrackMem, TrackTickT, TrackFlockSizes, TrackLocality;
 };
 
 struct ParamsStruct
@@ -94,8 +151,14 @@ inline void ParseParams(const std::string &FilePath)
         Input >> Tmp;
         if (Input.bad() || Input.fail())
             break;
-        if (Tmp.at(0) == '[' || Tmp.at(0) == '#') // ignoring labels & comments
+        if (Tmp.at(0) == '[') // ignoring labels
+            continue;
+        if (Tmp.at(0) == '#')
+        {
+            // ignoring comments (up to the end of the line, as they can mention params)
+            std::getline(Input, Tmp);
             continue;
+        }
         std::string ParamName = Tmp.substr(0, Tmp.find(Delim));
         std::string ParamValue = Tmp.substr(Tmp.find(Delim) + 1, Tmp.size());
         if (!ParamName.compare("num_boids"))
@@ -104,6 +167,8 @@ inline void ParseParams(const std::string &FilePath)
             GlobalParams.SimulatorParams.NumIterations = std::stoi(ParamValue);
         else if (!ParamName.compare("num_threads"))
             GlobalParams.SimulatorParams.NumThreads = std::stoi(ParamValue);
+        else if (!ParamName.compare("warmup_ticks"))
+            GlobalParams.SimulatorParams.WarmupTicks = std::stoi(ParamValue);
         else if (!ParamName.compare("timestep"))
             GlobalParams.SimulatorParams.DeltaTime = std::stod(ParamValue);
         else if (!ParamName.compare("boid_radius"))
@@ -128,14 +193,38 @@ inline void ParseParams(const std::string &FilePath)
             GlobalParams.SimulatorParams.RenderingMovie = stob(ParamValue);
         else if (!ParamName.compare("par_flocks"))
             GlobalParams.SimulatorParams.ParallelizeAcrossFlocks = stob(ParamValue);
+        else if (!ParamName.compare("dataflow"))
+            GlobalParams.SimulatorParams.UseDataflow = stob(ParamValue);
+        else if (!ParamName.compare("work_stealing"))
+            GlobalParams.SimulatorParams.UseWorkStealing = stob(ParamValue);
+        else if (!ParamName.compare("affinity"))
+            GlobalParams.SimulatorParams.UseAffinity = stob(ParamValue);
+        else if (!ParamName.compare("affinity_imbalance"))
+            GlobalParams.SimulatorParams.AffinityImbalance = std::stod(ParamValue);
+        else if (!ParamName.compare("numa"))
+            GlobalParams.SimulatorParams.UseNuma = stob(ParamValue);
+        else if (!ParamName.compare("weak_scaling"))
+            GlobalParams.SimulatorParams.WeakScaling = stob(ParamValue);
         else if (!ParamName.compare("colour_mode"))
             GlobalParams.BoidParams.ColourByThread = stob(ParamValue);
+        else if (!ParamName.compare("use_simd"))
+            GlobalParams.BoidParams.UseSIMD = stob(ParamValue);
+        else if (!ParamName.compare("verlet_skin"))
+            GlobalParams.BoidParams.VerletSkin = std::stod(ParamValue);
+        else if (!ParamName.compare("double_buffer"))
+            GlobalParams.BoidParams.DoubleBuffer = stob(ParamValue);
         else if (!ParamName.compare("max_size"))
             GlobalParams.FlockParams.MaxSize = std::stoi(ParamValue);
         else if (!ParamName.compare("max_flock_delegation"))
             GlobalParams.FlockParams.MaxNumComm = std::stoi(ParamValue);
         else if (!ParamName.compare("is_local_neighbourhood"))
             GlobalParams.FlockParams.UseLocalNeighbourhoods = stob(ParamValue);
+        else if (!ParamName.compare("use_spatial_grid"))
+            GlobalParams.FlockParams.UseSpatialGrid = stob(ParamValue);
+        else if (!ParamName.compare("reorder_interval"))
+            GlobalParams.FlockParams.ReorderInterval = std::stoi(ParamValue);
+        else if (!ParamName.compare("split_size"))
+            GlobalParams.FlockParams.SplitSize = std::stoi(ParamValue);
         else if (!ParamName.compare("track_mem"))
             GlobalParams.TracerParams.TrackMem = stob(ParamValue);
         else if (!ParamName.compare("track_tick_t"))
@@ -148,8 +237,16 @@ inline void ParseParams(const std::string &FilePath)
             GlobalParams.FlockParams.UseFlocks = stob(ParamValue);
         else if (!ParamName.compare("track_flock_sizes"))
             GlobalParams.TracerParams.TrackFlockSizes = stob(ParamValue);
+        else if (!ParamName.compare("track_locality"))
+            GlobalParams.TracerParams.TrackLocality = stob(ParamValue);
         else if (!ParamName.compare("render_flock_bounding_box"))
             GlobalParams.ImageParams.RenderBB = stob(ParamValue);
+        else if (!ParamName.compare("render_queue"))
+            GlobalParams.ImageParams.RenderQueue = std::stoi(ParamValue);
+        else if (!ParamName.compare("render_threads"))
+            GlobalParams.ImageParams.RenderThreads = std::stoi(ParamValue);
+        else if (!ParamName.compare("render_tile_size"))
+            GlobalParams.ImageParams.RenderTileSize = std::stoi(ParamValue);
         else
             continue;
     }
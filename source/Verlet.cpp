@@ -0,0 +1,156 @@
+#include "Verlet.hpp"
+#include "Grid.hpp"  // to find the candidates
+#include <algorithm> // std::max
+#include <omp.h>     // OpenMP
+
+// declaring static variables
+float VerletList::Skin;
+bool VerletList::Valid = false;
+std::vector<size_t> VerletList::ListStart;
+std::vector<size_t> VerletList::Candidates;
+AlignedVector<float> VerletList::RefX;
+AlignedVector<float> VerletList::RefY;
+size_t VerletList::TotalCandidates = 0;
+size_t VerletList::NumRebuilds = 0;
+size_t VerletList::NumUpdates = 0;
+float VerletList::MaxDispSqr = 0;
+
+void VerletList::Init()
+{
+    Skin = GlobalParams.BoidParams.VerletSkin;
+    Valid = false;
+    NumRebuilds = 0;
+    NumUpdates = 0;
+    TotalCandidates = 0;
+}
+
+bool VerletList::IsEnabled()
+{
+    return GlobalParams.BoidParams.VerletSkin > 0;
+}
+
+void VerletList::Invalidate()
+{
+    Valid = false;
+}
+
+const size_t *VerletList::Begin(const size_t Idx)
+{
+    assert(Valid && Idx + 1 < ListStart.size());
+    return Candidates.data() + ListStart[Idx];
+}
+
+const size_t *VerletList::End(const size_t Idx)
+{
+    assert(Valid && Idx + 1 < ListStart.size());
+    return Candidates.data() + ListStart[Idx + 1];
+}
+
+double VerletList::AvgCandidates()
+{
+    if (NumRebuilds == 0 || RefX.size() == 0)
+        return 0;
+    return double(TotalCandidates) / (NumRebuilds * RefX.size());
+}
+
+float VerletList::MaxDisplacementSqr()
+{
+    const BoidSoA &SoA = NLayout::GetSoA();
+    /// NOTE: every thread of the region runs this function, so the per-thread maxima
+    // are combined into a (shared) static
+#pragma omp single
+    MaxDispSqr = 0; // implicit barrier
+    float MyMaxDispSqr = 0;
+#pragma omp for schedule(static) nowait
+    for (size_t i = 0; i < SoA.Size(); i++)
+    {
+        const float DispSqr = sqr(SoA.X[i] - RefX[i]) + sqr(SoA.Y[i] - RefY[i]);
+        if (DispSqr > MyMaxDispSqr)
+            MyMaxDispSqr = DispSqr;
+    }
+#pragma omp critical(VerletMaxDisp)
+    MaxDispSqr = std::max(MaxDispSqr, MyMaxDispSqr);
+#pragma omp barrier
+    return MaxDispSqr;
+}
+
+void VerletList::Update()
+{
+    /// NOTE: as long as no boid has moved more than Skin / 2 since the lists were
+    // built, no two boids can have closed more than Skin of distance between them,
+    // so every boid within NeighbourhoodRadius is still in the lists
+    assert(IsEnabled());
+    /// WARNING: every thread must reach the same decision here (so they all enter
+    // Rebuild), which holds since Valid & RefX only change inside Rebuild's barriers
+    const bool MustRebuild = !Valid || RefX.size() != NLayout::GetSoA().Size();
+    if (MustRebuild || MaxDisplacementSqr() > sqr(0.5f * Skin))
+    {
+        Rebuild();
+    }
+#pragma omp single nowait
+    NumUpdates++;
+}
+
+void VerletList::Rebuild()
+{
+    SpatialGrid::Rebuild(); // bin all boids into their cells
+    const BoidSoA &SoA = NLayout::GetSoA();
+    const BoidSoA &Cells = SpatialGrid::GetCells();
+    const size_t N = SoA.Size();
+    const float Radius = GlobalParams.BoidParams.NeighbourhoodRadius + Skin;
+    const size_t Rings = SpatialGrid::NumRings(Radius);
+#pragma omp single
+    {
+        ListStart.assign(N + 1, 0);
+        RefX.resize(N);
+        RefY.resize(N);
+    } // implicit barrier
+    // first count how many candidates each boid has
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        const Vec2D Pos(SoA.X[i], SoA.Y[i]);
+        size_t Count = 0;
+        SpatialGrid::ForEachRow(Pos, Rings, [&](const size_t Begin, const size_t End) {
+            for (size_t k = Begin; k < End; k++)
+            {
+                if (Cells.BoidIDs[k] != SoA.BoidIDs[i] &&
+                    (Vec2D(Cells.X[k], Cells.Y[k]) - Pos).SizeSqr() <= sqr(Radius))
+                    Count++;
+            }
+        });
+        ListStart[i + 1] = Count;
+        RefX[i] = SoA.X[i];
+        RefY[i] = SoA.Y[i];
+    }
+#pragma omp single
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            ListStart[i + 1] += ListStart[i]; // prefix sum
+        }
+        Candidates.resize(ListStart[N]);
+    } // implicit barrier
+    // then fill them in (in cell order, so the lists are spatially coherent)
+#pragma omp for schedule(static)
+    for (size_t i = 0; i < N; i++)
+    {
+        const Vec2D Pos(SoA.X[i], SoA.Y[i]);
+        size_t Next = ListStart[i];
+        SpatialGrid::ForEachRow(Pos, Rings, [&](const size_t Begin, const size_t End) {
+            for (size_t k = Begin; k < End; k++)
+            {
+                if (Cells.BoidIDs[k] != SoA.BoidIDs[i] &&
+                    (Vec2D(Cells.X[k], Cells.Y[k]) - Pos).SizeSqr() <= sqr(Radius))
+                    Candidates[Next++] = Cells.BoidIDs[k];
+            }
+        });
+        assert(Next == ListStart[i + 1]);
+    } // implicit barrier
+#pragma omp single
+    {
+        TotalCandidates += Candidates.size();
+        NumRebuilds++;
+        Valid = true;
+    } // implicit barrier
+}
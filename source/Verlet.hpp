@@ -0,0 +1,39 @@
+#ifndef VERLET
+#define VERLET
+
+#include "Neighbourhood.hpp" // BoidSoA
+#include "Utils.hpp"         // Params
+#include <vector>            // std::vector
+
+class VerletList // per-boid neighbour candidates, reused across ticks
+{
+  public:
+    static void Init();
+    static bool IsEnabled();
+    // rebuild the lists only if some boid could have moved into range
+    // (called by every thread of the tick's parallel region)
+    static void Update();
+    // force a rebuild on the next update (ie. after boids are renumbered)
+    static void Invalidate();
+    // candidates (indices into the SoA) of the boid at Idx in the SoA
+    static const size_t *Begin(const size_t Idx);
+    static const size_t *End(const size_t Idx);
+    static size_t NumRebuilds, NumUpdates;
+    static double AvgCandidates();
+
+  private:
+    static void Rebuild();
+    static float MaxDisplacementSqr();
+    // candidates are within NeighbourhoodRadius + Skin when the lists are built
+    static float Skin;
+    static bool Valid;
+    // ListStart[i] is the first index of boid i's candidates in Candidates (CSR style)
+    static std::vector<size_t> ListStart;
+    static std::vector<size_t> Candidates;
+    // where every boid was when the lists were built
+    static AlignedVector<float> RefX, RefY;
+    static size_t TotalCandidates;
+    static float MaxDispSqr; // (shared by the threads computing it)
+};
+
+#endif
\ No newline at end of file
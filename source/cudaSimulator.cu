@@ -1,12 +1,13 @@
-#include "Flock.hpp"  // Flocks
-#include "Tracer.hpp" // Tracer
-#include "Utils.hpp"  // Params
-#include "Vec.hpp"    // Vec3D
-#include <chrono>     // timing threads
-#include <omp.h>      // OpenMP
-#include <string>     // cout
-#include <unordered_map>
-#include <vector> // std::vector
+#include "Arena.hpp"    // Arena
+#include "Flock.hpp"    // Flocks
+#include "FlockMap.hpp" // FlockMap
+#include "Tracer.hpp"   // Tracer
+#include "Utils.hpp"    // Params
+#include "Vec.hpp"      // Vec3D
+#include <chrono>       // timing threads
+#include <omp.h>        // OpenMP
+#include <string>       // cout
+#include <vector>       // std::vector
 
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -183,16 +184,19 @@ class Simulator
                   << GlobalParams.ImageParams.WindowX << ", " << GlobalParams.ImageParams.WindowY << ") world with "
                   << Params.NumThreads << " threads" << std::endl;
 
+        // Initialize the per-thread tick arenas (for transient buffers)
+        Arena::Init();
         // Initialize neighbourhood layout for flocks before use
         Flock::InitNeighbourhoodLayout();
         // Spawn flocks
+        AllFlocks.Reserve(Params.NumBoids);
         for (size_t i = 0; i < Params.NumBoids; i++)
         {
-            AllFlocks[i] = Flock(i, 1);
+            AllFlocks.Insert(Flock(i, 1));
         }
 
         // begin tracking which flocks communicate with which
-        Tracer::InitFlockMatrix(AllFlocks.size());
+        Tracer::InitFlockMatrix(AllFlocks.Size());
 
         // Allocate and initialize device memory data
         Setup();
@@ -205,7 +209,7 @@ class Simulator
         }
     }
     static SimulatorParamsStruct Params;
-    std::unordered_map<size_t, Flock> AllFlocks;
+    FlockMap AllFlocks;
     Image I;
 
     void Simulate()
@@ -231,7 +235,7 @@ class Simulator
 
     void InitBoidDataArrays()
     {
-        std::vector<Boid> &AllBoids = *(AllFlocks.begin()->second.Neighbourhood.GetAllBoidsPtr());
+        std::vector<Boid> &AllBoids = *(AllFlocks[0].Neighbourhood.GetAllBoidsPtr());
         size_t vecSize = sizeof(float) * 2 * numBoids;
         size_t intSize = sizeof(int) * numBoids;
 
@@ -258,12 +262,13 @@ class Simulator
      */
     void UpdateBoidPosAndVel()
     {
-        std::vector<Boid> &AllBoids = *(AllFlocks.begin()->second.Neighbourhood.GetAllBoidsPtr());
+        std::vector<Boid> &AllBoids = *(AllFlocks[0].Neighbourhood.GetAllBoidsPtr());
         for (size_t i = 0; i < AllBoids.size(); i++)
         {
             Boid &B = AllBoids[i];
             B.Position = Vec2D(position[2 * i], position[2 * i + 1]);
             B.Velocity = Vec2D(velocity[2 * i], velocity[2 * i + 1]);
+            NLayout::StoreSoA(B); // keep the hot state in sync
         }
     }
 
@@ -277,7 +282,7 @@ class Simulator
         auto StartTime = std::chrono::system_clock::now();
 
         // allocate boid and flock memory
-        std::vector<Boid> &AllBoids = *(AllFlocks.begin()->second.Neighbourhood.GetAllBoidsPtr());
+        std::vector<Boid> &AllBoids = *(AllFlocks[0].Neighbourhood.GetAllBoidsPtr());
         numBoids = AllBoids.size();
         size_t vecSize = sizeof(float) * 2 * numBoids;
         size_t intSize = sizeof(int) * numBoids;
@@ -316,6 +321,8 @@ class Simulator
     {
         // Run our actual problem (boid computation)
         auto StartTime = std::chrono::system_clock::now();
+        // drop all of last tick's transient buffers
+        Arena::Reset();
 
         const int threadsPerBlock = 64;
         const int numBlocks = (numBoids + threadsPerBlock - 1) / threadsPerBlock;
@@ -330,6 +337,8 @@ class Simulator
 
         UpdateBoidPosAndVel();
         std::vector<Flock *> AllFlockPtrs = GetAllFlocksVector();
+#pragma omp parallel num_threads(Params.NumThreads) // (run by the whole team)
+        Flock::FindNearbyFlocks(AllFlocks);
 
         UpdateFlocks(AllFlockPtrs);
 
@@ -351,13 +360,11 @@ class Simulator
     std::vector<Flock *> GetAllFlocksVector() const
     {
         std::vector<Flock *> AllFlocksVec;
-        for (auto It = AllFlocks.begin(); It != AllFlocks.end(); It++)
+        for (const Flock &F : AllFlocks)
         {
-            assert(It != AllFlocks.end());
-            const Flock &F = It->second;
             AllFlocksVec.push_back(const_cast<Flock *>(&F));
         }
-        assert(AllFlocksVec.size() == AllFlocks.size());
+        assert(AllFlocksVec.size() == AllFlocks.Size());
         return AllFlocksVec;
     }
 
@@ -371,7 +378,13 @@ class Simulator
 #pragma omp for schedule(static)
                 for (size_t i = 0; i < AllFlocksVec.size(); i++)
                 {
-                    AllFlocksVec[i]->Delegate(omp_get_thread_num(), AllFlocksVec);
+                    AllFlocksVec[i]->Delegate(omp_get_thread_num());
+                }
+#pragma omp barrier
+#pragma omp for schedule(static)
+                for (size_t i = 0; i < AllFlocksVec.size(); i++)
+                {
+                    AllFlocksVec[i]->ReserveImmigrants();
                 }
 #pragma omp barrier
 #pragma omp for schedule(static)
@@ -380,6 +393,23 @@ class Simulator
                     AllFlocksVec[i]->AssignToFlock(omp_get_thread_num());
                 }
             }
+        }
+        if (GlobalParams.FlockParams.UseFlocks && NLayout::GetType() == NLayout::Global)
+        {
+            // global migrations only changed the boids' owners, so regroup them by flock
+#pragma omp parallel num_threads(Params.NumThreads) // (run by the whole team)
+            NLayout::RebuildMembership();
+        }
+#pragma omp parallel num_threads(Params.NumThreads) // spawns threads
+        {
+            if (GlobalParams.FlockParams.UseFlocks)
+            {
+#pragma omp for schedule(static)
+                for (size_t i = 0; i < AllFlocksVec.size(); i++)
+                {
+                    AllFlocksVec[i]->RemoveEmigrants();
+                }
+            }
 #pragma omp barrier
 #pragma omp for schedule(static)
             for (size_t i = 0; i < AllFlocksVec.size(); i++)
@@ -390,6 +420,7 @@ class Simulator
         // convert flock data to processor communications
         Tracer::SaveFlockMatrix(AllFlocks);
         // remove empty (invalid) flocks
+#pragma omp parallel num_threads(Params.NumThreads)
         Flock::CleanUp(AllFlocks);
     }
 
@@ -0,0 +1,397 @@
+#include "Boid.hpp"       // Boids
+#include "CellList.hpp"   // CellList
+#include "Grid.hpp"       // SpatialGrid
+#include "PlanKernel.hpp" // SIMD kernels
+#include "Tracer.hpp"     // Tracer
+#include "Utils.hpp"      // Params
+#include "Vec.hpp"        // Vec2D
+#include <algorithm>      // std::sort
+#include <cmath>          // std::floor
+#include <mpi.h>          // MPI
+#include <omp.h>          // OpenMP
+#include <string>         // cout
+#include <vector>         // std::vector
+
+/// NOTE: the distributed simulator splits the world into one tile per rank (in a grid
+// of Dims[0] x Dims[1] tiles), every rank only simulates the boids within its tile and
+// every tick it receives (halo) copies of the boids within neighbourhood_radius of its
+// tile from the (up to 8) neighbouring ranks. Boids that leave a tile are migrated to
+// their new owner (always a neighbour) once they have acted. Flocks are not
+// distributed (their membership only decides which boids are candidate neighbours, so
+// the boids move the same without them)
+
+struct BoidMsg // everything a rank needs of another rank's boid (sent as raw bytes)
+{
+    float X, Y, VX, VY;
+    size_t BoidID;
+};
+
+class Simulator
+{
+  public:
+    Simulator()
+    {
+        Params = GlobalParams.SimulatorParams;
+        MPI_Comm_rank(MPI_COMM_WORLD, &Rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &NumRanks);
+        Dims[0] = Dims[1] = 0;
+        MPI_Dims_create(NumRanks, 2, Dims);
+        Coords[0] = Rank % Dims[0];
+        Coords[1] = Rank / Dims[0];
+        if (Params.WeakScaling)
+        {
+            // every rank gets a tile (& boids) the size of the whole single-rank world
+            Params.NumBoids *= NumRanks;
+            GlobalParams.SimulatorParams.NumBoids = Params.NumBoids;
+            GlobalParams.ImageParams.WindowX *= Dims[0];
+            GlobalParams.ImageParams.WindowY *= Dims[1];
+        }
+        TileW = float(GlobalParams.ImageParams.WindowX) / Dims[0];
+        TileH = float(GlobalParams.ImageParams.WindowY) / Dims[1];
+        NumThreads = (Params.NumThreads > 0) ? Params.NumThreads : omp_get_max_threads();
+        // Print out status
+        if (Rank == 0)
+        {
+            std::cout << "Running on " << Params.NumBoids << " boids for " << Params.NumIterations
+                      << " iterations in a (" << GlobalParams.ImageParams.WindowX << ", "
+                      << GlobalParams.ImageParams.WindowY << ") world with " << NumRanks << " ranks (" << Dims[0]
+                      << "x" << Dims[1] << " tiles) of " << NumThreads << " threads" << std::endl;
+            if (Params.RenderingMovie)
+                std::cout << "Ignoring render (the boids are spread over the ranks)" << std::endl;
+        }
+        /// WARNING: halos only come from & boids only migrate to the 8 adjacent tiles, so
+        // no tile can be narrower than the neighbourhood radius or a tick's move
+        const float Radius = GlobalParams.BoidParams.NeighbourhoodRadius;
+        const float Step = GlobalParams.BoidParams.MaxVel * Params.DeltaTime;
+        if (TileW < std::max(Radius, Step) || TileH < std::max(Radius, Step))
+        {
+            if (Rank == 0)
+                std::cerr << "Tiles (" << TileW << "x" << TileH << ") must be at least neighbourhood_radius ("
+                          << Radius << ") & max_vel * timestep (" << Step << ") wide" << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        // the ranks of the adjacent tiles (in increasing rank order)
+        for (int DY = -1; DY <= 1; DY++)
+        {
+            for (int DX = -1; DX <= 1; DX++)
+            {
+                const int TX = Coords[0] + DX, TY = Coords[1] + DY;
+                NeighbourIdx[DY + 1][DX + 1] = -1;
+                if ((DX == 0 && DY == 0) || TX < 0 || TX >= Dims[0] || TY < 0 || TY >= Dims[1])
+                    continue;
+                NeighbourIdx[DY + 1][DX + 1] = int(Neighbours.size());
+                Neighbours.push_back(TX + TY * Dims[0]);
+            }
+        }
+        SendTo.resize(Neighbours.size());
+
+        // the cells are global (so every rank sorts the boids the same way)
+        SpatialGrid::Init();
+        // Pick the widest planning kernel this cpu supports
+        PlanKernel::Init();
+        if (Rank == 0)
+            std::cout << "Planning with the " << PlanKernel::Name() << " kernel" << std::endl;
+        // Spawn boids, every rank draws all of them (so they match the single-process
+        // simulator's) but only keeps those in its tile
+        for (size_t i = 0; i < Params.NumBoids; i++)
+        {
+            const Boid B(i);
+            if (OwnerOf(B.Position) == Rank)
+                Owned.push_back(B);
+        }
+    }
+    static SimulatorParamsStruct Params;
+    int Rank, NumRanks, NumThreads;
+    int Dims[2], Coords[2]; // tiles in the world, & which one is ours
+    float TileW, TileH;
+    std::vector<Boid> Owned; // the boids in our tile
+    CellList Cells; // our boids & our halo
+    std::vector<int> Neighbours; // ranks of the adjacent tiles
+    int NeighbourIdx[3][3];      // index in Neighbours of the tile at (DY + 1, DX + 1) (or -1)
+    // (reused) buffers for the exchanges, SendTo[n] goes to Neighbours[n]
+    std::vector<std::vector<BoidMsg>> SendTo;
+    std::vector<BoidMsg> Received;
+    std::vector<int> SendCounts, RecvCounts;
+    std::vector<MPI_Request> Requests;
+    // stats
+    double ComputeTime = 0, HaloTime = 0, MigrateTime = 0;
+    size_t HaloBoids = 0, MigratedBoids = 0;
+
+    int OwnerOf(const Vec2D &Pos) const
+    {
+        // boids that wander outside the window belong to the border tiles
+        const int TX = int(std::min(std::max(std::floor(Pos[0] / TileW), 0.f), float(Dims[0] - 1)));
+        const int TY = int(std::min(std::max(std::floor(Pos[1] / TileH), 0.f), float(Dims[1] - 1)));
+        return TX + TY * Dims[0];
+    }
+
+    static BoidMsg ToMsg(const Boid &B)
+    {
+        return {B.Position[0], B.Position[1], B.Velocity[0], B.Velocity[1], B.BoidID};
+    }
+
+    void Exchange()
+    {
+        // sends SendTo[n] to every neighbour n, and receives everything sent to us in Received
+        /// NOTE: only the (up to 8) neighbours ever talk to each other, so the ranks far
+        // apart don't synchronize (like they would in a global all-to-all)
+        const int N = int(Neighbours.size());
+        SendCounts.resize(N);
+        RecvCounts.resize(N);
+        Requests.resize(2 * N);
+        for (int n = 0; n < N; n++)
+        {
+            SendCounts[n] = int(SendTo[n].size() * sizeof(BoidMsg));
+            MPI_Irecv(&RecvCounts[n], 1, MPI_INT, Neighbours[n], 0, MPI_COMM_WORLD, &Requests[n]);
+            MPI_Isend(&SendCounts[n], 1, MPI_INT, Neighbours[n], 0, MPI_COMM_WORLD, &Requests[N + n]);
+        }
+        MPI_Waitall(2 * N, Requests.data(), MPI_STATUSES_IGNORE);
+        size_t RecvBytes = 0;
+        for (int n = 0; n < N; n++)
+        {
+            RecvBytes += RecvCounts[n];
+        }
+        // (in increasing rank order, like a global all-to-all would)
+        Received.resize(RecvBytes / sizeof(BoidMsg));
+        char *Next = reinterpret_cast<char *>(Received.data());
+        for (int n = 0; n < N; n++)
+        {
+            MPI_Irecv(Next, RecvCounts[n], MPI_BYTE, Neighbours[n], 1, MPI_COMM_WORLD, &Requests[n]);
+            MPI_Isend(SendTo[n].data(), SendCounts[n], MPI_BYTE, Neighbours[n], 1, MPI_COMM_WORLD, &Requests[N + n]);
+            Next += RecvCounts[n];
+        }
+        MPI_Waitall(2 * N, Requests.data(), MPI_STATUSES_IGNORE);
+        for (std::vector<BoidMsg> &Buf : SendTo)
+        {
+            Buf.clear();
+        }
+    }
+
+    void ExchangeHalo()
+    {
+        // send every boid within neighbourhood_radius of an adjacent tile to its rank
+        /// NOTE: checking each axis separately also sends the boids just outside the
+        // radius of a diagonal tile, which are then ignored by the distance checks
+        const float Radius = GlobalParams.BoidParams.NeighbourhoodRadius;
+        const float X0 = Coords[0] * TileW, X1 = X0 + TileW;
+        const float Y0 = Coords[1] * TileH, Y1 = Y0 + TileH;
+        for (const Boid &B : Owned)
+        {
+            const float X = B.Position[0], Y = B.Position[1];
+            const bool Near[2][3] = {{X < X0 + Radius, true, X >= X1 - Radius},
+                                     {Y < Y0 + Radius, true, Y >= Y1 - Radius}};
+            for (int DY = -1; DY <= 1; DY++)
+            {
+                for (int DX = -1; DX <= 1; DX++)
+                {
+                    const int n = NeighbourIdx[DY + 1][DX + 1];
+                    if (n >= 0 && Near[0][DX + 1] && Near[1][DY + 1])
+                        SendTo[n].push_back(ToMsg(B));
+                }
+            }
+        }
+        Exchange();
+        HaloBoids += Received.size();
+    }
+
+    void BuildCells()
+    {
+        // (sorted by cell then by BoidID, so every boid senses its neighbours in the
+        // same order no matter how many ranks there are)
+        Cells.Clear();
+        for (const Boid &B : Owned)
+        {
+            Cells.Add(B.Position[0], B.Position[1], B.Velocity[0], B.Velocity[1], B.BoidID);
+        }
+        for (const BoidMsg &M : Received)
+        {
+            Cells.Add(M.X, M.Y, M.VX, M.VY, M.BoidID);
+        }
+        Cells.Build();
+    }
+
+    void SenseAndAct()
+    {
+#pragma omp parallel for schedule(static) num_threads(NumThreads)
+        for (size_t i = 0; i < Owned.size(); i++)
+        {
+            Boid &B = Owned[i];
+            Vec2D RelCOM, RelCOV, Sep;
+            size_t NumCloseby = 0;
+            Cells.Plan(B.Position, B.BoidID, RelCOM, RelCOV, Sep, NumCloseby);
+            B.SetForces(RelCOM, RelCOV, Sep, NumCloseby);
+        } // implicit barrier
+#pragma omp parallel for schedule(static) num_threads(NumThreads)
+        for (size_t i = 0; i < Owned.size(); i++)
+        {
+            Owned[i].Move(Params.DeltaTime);
+        }
+    }
+
+    void Migrate()
+    {
+        // hand the boids that left our tile over to their new owners
+        size_t Next = 0;
+        for (size_t i = 0; i < Owned.size(); i++)
+        {
+            const int Owner = OwnerOf(Owned[i].Position);
+            if (Owner != Rank)
+            {
+                const int DX = Owner % Dims[0] - Coords[0], DY = Owner / Dims[0] - Coords[1];
+                assert(std::abs(DX) <= 1 && std::abs(DY) <= 1); // (no boid moves further in a tick)
+                const int n = NeighbourIdx[DY + 1][DX + 1];
+                assert(n >= 0 && Neighbours[n] == Owner);
+                SendTo[n].push_back(ToMsg(Owned[i]));
+            }
+            else
+            {
+                Owned[Next++] = Owned[i];
+            }
+        }
+        Owned.resize(Next);
+        Exchange();
+        MigratedBoids += Received.size();
+        for (const BoidMsg &M : Received)
+        {
+            Boid B;
+            B.Position = Vec2D(M.X, M.Y);
+            B.Velocity = Vec2D(M.VX, M.VY);
+            B.BoidID = M.BoidID;
+            B.FlockID = M.BoidID; // (every boid is its own flock)
+            Owned.push_back(B);
+        }
+    }
+
+    void Tick()
+    {
+        const double Start = MPI_Wtime();
+        ExchangeHalo();
+        const double HaloEnd = MPI_Wtime();
+        BuildCells();
+        SenseAndAct();
+        const double ComputeEnd = MPI_Wtime();
+        Migrate();
+        const double End = MPI_Wtime();
+        HaloTime += HaloEnd - Start;
+        ComputeTime += ComputeEnd - HaloEnd;
+        MigrateTime += End - ComputeEnd;
+        // (the slowest rank's tick is everyone's tick)
+        double TickTime = End - Start;
+        MPI_Allreduce(MPI_IN_PLACE, &TickTime, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        Tracer::AddTickT(TickTime);
+    }
+
+    void Simulate()
+    {
+        MPI_Barrier(MPI_COMM_WORLD);
+        const double Start = MPI_Wtime();
+        for (size_t i = 0; i < Params.NumIterations; i++)
+        {
+            Tick();
+            if (Rank == 0)
+                std::cout << "Tick: " << i << "\r" << std::flush; // carriage return, no newline
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        const double ElapsedTime = MPI_Wtime() - Start;
+        if (Rank == 0)
+            std::cout << "Finished simulation! Took " << ElapsedTime << "s" << std::endl;
+        Report();
+    }
+
+    void Report()
+    {
+        // where the time went on the slowest rank (for strong & weak scaling)
+        double Times[3] = {ComputeTime, HaloTime, MigrateTime};
+        MPI_Allreduce(MPI_IN_PLACE, Times, 3, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        unsigned long long Counts[2] = {HaloBoids, MigratedBoids};
+        MPI_Allreduce(MPI_IN_PLACE, Counts, 2, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+        unsigned long long MinOwned = Owned.size(), MaxOwned = Owned.size();
+        MPI_Allreduce(MPI_IN_PLACE, &MinOwned, 1, MPI_UNSIGNED_LONG_LONG, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &MaxOwned, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+        const double Checksum = PositionChecksum();
+        if (Rank != 0)
+            return;
+        const double NumTicks = std::max(size_t(1), Params.NumIterations);
+        std::cout << "Slowest rank: " << Times[0] << "s sensing & acting, " << Times[1] << "s exchanging halos, "
+                  << Times[2] << "s migrating" << std::endl;
+        std::cout << "Boids per rank: " << MinOwned << " to " << MaxOwned << " (imbalance "
+                  << MaxOwned * NumRanks / double(Params.NumBoids) << ")" << std::endl;
+        std::cout << "Halo boids per rank per tick: " << Counts[0] / (NumTicks * NumRanks) << ", migrated boids per tick: "
+                  << Counts[1] / NumTicks << std::endl;
+        std::cout.precision(12);
+        std::cout << "Boid position checksum: " << Checksum << std::endl;
+        std::cout.precision(6);
+    }
+
+    double PositionChecksum()
+    {
+        /// NOTE: summed on rank 0 in BoidID order, so it is bit-identical across rank
+        // counts as long as the boids are (ie. with the scalar planning kernel)
+        std::vector<BoidMsg> Mine;
+        for (const Boid &B : Owned)
+        {
+            Mine.push_back(ToMsg(B));
+        }
+        int MyBytes = int(Mine.size() * sizeof(BoidMsg));
+        std::vector<int> Bytes(NumRanks), Displs(NumRanks);
+        MPI_Gather(&MyBytes, 1, MPI_INT, Bytes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        size_t Total = 0;
+        for (int r = 0; r < NumRanks; r++)
+        {
+            Displs[r] = int(Total);
+            Total += Bytes[r];
+        }
+        std::vector<BoidMsg> All(Total / sizeof(BoidMsg));
+        MPI_Gatherv(Mine.data(), MyBytes, MPI_BYTE, All.data(), Bytes.data(), Displs.data(), MPI_BYTE, 0,
+                    MPI_COMM_WORLD);
+        if (Rank != 0)
+            return 0;
+        assert(All.size() == Params.NumBoids);
+        std::sort(All.begin(), All.end(), [](const BoidMsg &A, const BoidMsg &B) { return A.BoidID < B.BoidID; });
+        double Sum = 0;
+        for (const BoidMsg &M : All)
+        {
+            Sum += double(M.X) + double(M.Y);
+        }
+        return Sum;
+    }
+};
+
+// declaring static variables
+SimulatorParamsStruct Simulator::Params;
+ImageParamsStruct Image::Params;
+TracerParamsStruct Tracer::Params;
+
+// global params struct
+ParamsStruct GlobalParams;
+
+int main(int argc, char *argv[])
+{
+    // only the main thread of every rank talks to the others
+    int Provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &Provided);
+    std::srand(0); // consistent seed (on every rank)
+    if (argc == 1)
+    {
+        ParseParams("params/params.ini");
+    }
+    else
+    {
+        const std::string ParamFile(argv[1]);
+        ParseParams("params/" + ParamFile);
+    }
+    // (flocks are not distributed, so there are no flock sizes to dump)
+    GlobalParams.TracerParams.TrackFlockSizes = false;
+    int Rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &Rank);
+    Tracer::Initialize();
+    {
+        Simulator Sim;
+        Sim.Simulate();
+    }
+    // Dump all tracer data (of the slowest ticks)
+    if (Rank == 0)
+        Tracer::Dump();
+    MPI_Finalize();
+    return 0;
+}
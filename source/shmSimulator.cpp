@@ -0,0 +1,343 @@
+#include "Boid.hpp"       // Boids
+#include "CellList.hpp"   // CellList
+#include "Grid.hpp"       // SpatialGrid
+#include "PlanKernel.hpp" // SIMD kernels
+#include "Tracer.hpp"     // Tracer
+#include "Utils.hpp"      // Params
+#include "Vec.hpp"        // Vec2D
+#include <algorithm>      // std::min, std::max
+#include <atomic>         // std::atomic
+#include <chrono>         // timing
+#include <cmath>          // std::floor
+#include <csignal>        // strsignal, SIGKILL
+#include <cstring>        // strerror
+#include <fcntl.h>        // open
+#include <new>            // placement new
+#include <sched.h>        // sched_yield
+#include <string>         // cout
+#include <sys/file.h>     // flock
+#include <sys/mman.h>     // mmap
+#include <sys/prctl.h>    // prctl
+#include <sys/stat.h>     // mkdir
+#include <sys/wait.h>     // waitpid
+#include <unistd.h>       // fork
+#include <vector>         // std::vector
+
+/// NOTE: the multi-process simulator runs num_threads (single threaded) processes over
+// one flat, memory-mapped copy of every boid's state (like NLayout::Global's), where
+// each worker owns the boids in its vertical slice of the world. The state is double
+// buffered, every tick reads one copy & writes the other, so a tick can always be
+// redone from scratch. A worker that dies is simply restarted (by the parent process)
+// and redoes its last unfinished tick (up to MaxRestarts times), while the workers die
+// with the parent & the state file is locked by one simulator at a time. Flocks are
+// not simulated (their membership only decides which boids are candidate neighbours,
+// so the boids move the same without them)
+
+class SharedState // the memory-mapped state file, laid out as flat arrays
+{
+  public:
+    struct alignas(64) Counter // (one per cache line)
+    {
+        std::atomic<size_t> Value;
+    };
+    // [Header | Done[NumWorkers] | X[2][N] | Y[2][N] | VX[2][N] | VY[2][N] | FlockIDs[N]]
+    struct Header
+    {
+        size_t NumBoids, NumWorkers;
+    };
+    Header *H = nullptr;
+    // Done[w] is how many ticks worker w has finished (also the process-shared barrier)
+    Counter *Done = nullptr;
+    float *X[2], *Y[2], *VX[2], *VY[2];
+    size_t *FlockIDs = nullptr;
+
+    static size_t Bytes(const size_t NumBoids, const size_t NumWorkers)
+    {
+        return sizeof(Counter) + NumWorkers * sizeof(Counter) + 8 * NumBoids * sizeof(float) +
+               NumBoids * sizeof(size_t);
+    }
+
+    bool Map(const std::string &Path, const size_t NumBoids, const size_t NumWorkers)
+    {
+        static_assert(sizeof(Header) <= sizeof(Counter), "the header fits in one cache line");
+        static_assert(ATOMIC_LONG_LOCK_FREE == 2, "atomics must work across processes");
+        const size_t Size = Bytes(NumBoids, NumWorkers);
+        const int FD = open(Path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (FD < 0)
+        {
+            std::cerr << "Cannot create " << Path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        /// NOTE: the lock is taken before truncating, so a second simulator can't shrink
+        // the file under another one's workers. It is held (through the inherited FD) for
+        // as long as we or any of our workers are alive
+        if (flock(FD, LOCK_EX | LOCK_NB) != 0)
+        {
+            std::cerr << "Cannot lock " << Path << ": " << strerror(errno) << " (is another ShmSimulator running?)"
+                      << std::endl;
+            close(FD);
+            return false;
+        }
+        if (ftruncate(FD, 0) != 0 || ftruncate(FD, Size) != 0)
+        {
+            std::cerr << "Cannot create " << Path << ": " << strerror(errno) << std::endl;
+            close(FD);
+            return false;
+        }
+        void *Base = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+        // (the FD stays open to keep the lock, the mapping keeps the file alive)
+        if (Base == MAP_FAILED)
+        {
+            std::cerr << "Cannot map " << Path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        char *Next = static_cast<char *>(Base);
+        H = reinterpret_cast<Header *>(Next);
+        H->NumBoids = NumBoids;
+        H->NumWorkers = NumWorkers;
+        Next += sizeof(Counter);
+        Done = reinterpret_cast<Counter *>(Next);
+        for (size_t w = 0; w < NumWorkers; w++)
+        {
+            new (&Done[w].Value) std::atomic<size_t>(0);
+        }
+        Next += NumWorkers * sizeof(Counter);
+        for (float **Arr : {X, Y, VX, VY})
+        {
+            for (size_t b = 0; b < 2; b++)
+            {
+                Arr[b] = reinterpret_cast<float *>(Next);
+                Next += NumBoids * sizeof(float);
+            }
+        }
+        FlockIDs = reinterpret_cast<size_t *>(Next);
+        return true;
+    }
+
+    void Barrier(const size_t Tick) const
+    {
+        // wait for every worker to have finished the first Tick ticks
+        /// NOTE: unlike a pthread barrier this only counts finished ticks, so a worker
+        // that dies (whether before or after arriving) can't leave it in a broken state
+        for (size_t w = 0; w < H->NumWorkers; w++)
+        {
+            while (Done[w].Value.load(std::memory_order_acquire) < Tick)
+                sched_yield();
+        }
+    }
+};
+
+class Simulator
+{
+  public:
+    Simulator()
+    {
+        Params = GlobalParams.SimulatorParams;
+        NumWorkers = std::max(1, Params.NumThreads);
+        SliceW = float(GlobalParams.ImageParams.WindowX) / NumWorkers;
+        // Print out status
+        std::cout << "Running on " << Params.NumBoids << " boids for " << Params.NumIterations << " iterations in a ("
+                  << GlobalParams.ImageParams.WindowX << ", " << GlobalParams.ImageParams.WindowY << ") world with "
+                  << NumWorkers << " worker processes" << std::endl;
+        if (Params.RenderingMovie)
+            std::cout << "Ignoring render (the boids are only in the state file)" << std::endl;
+        // the cells are global (so every worker sorts the boids the same way)
+        SpatialGrid::Init();
+        // Pick the widest planning kernel this cpu supports
+        PlanKernel::Init();
+        std::cout << "Planning with the " << PlanKernel::Name() << " kernel" << std::endl;
+    }
+    static SimulatorParamsStruct Params;
+    size_t NumWorkers;
+    float SliceW;
+    SharedState S;
+    const std::string StatePath = "out/boids.state";
+    size_t NumRestarts = 0;
+    // a worker that keeps dying (eg. from a deterministic bug) is given up on after this
+    static const size_t MaxRestarts = 10;
+
+    bool Init()
+    {
+        // write every boid's initial state (the same as the single-process simulator's)
+        mkdir("out", 0755);
+        if (!S.Map(StatePath, Params.NumBoids, NumWorkers))
+            return false;
+        for (size_t i = 0; i < Params.NumBoids; i++)
+        {
+            const Boid B(i);
+            S.X[0][i] = B.Position[0];
+            S.Y[0][i] = B.Position[1];
+            S.VX[0][i] = B.Velocity[0];
+            S.VY[0][i] = B.Velocity[1];
+            S.FlockIDs[i] = B.FlockID;
+        }
+        return true;
+    }
+
+    size_t OwnerOf(const float X) const
+    {
+        // boids that wander outside the window belong to the border slices
+        return size_t(std::min(std::max(std::floor(X / SliceW), 0.f), float(NumWorkers - 1)));
+    }
+
+    void Work(const size_t W)
+    {
+        /// NOTE: runs in worker process W (from whichever tick it last left off at)
+        const float Radius = GlobalParams.BoidParams.NeighbourhoodRadius;
+        // our slice & the halo around it (where the boids we could sense are)
+        const float X0 = (W == 0) ? -INFINITY : W * SliceW - Radius;
+        const float X1 = (W == NumWorkers - 1) ? INFINITY : (W + 1) * SliceW + Radius;
+        CellList Cells;
+        std::vector<size_t> Owned;
+        for (size_t T = S.Done[W].Value.load(); T < Params.NumIterations; T++)
+        {
+            S.Barrier(T); // everyone has written the state we read
+            const size_t Cur = T % 2, Next = 1 - Cur;
+            Cells.Clear();
+            Owned.clear();
+            for (size_t i = 0; i < Params.NumBoids; i++)
+            {
+                const float X = S.X[Cur][i];
+                if (X < X0 || X >= X1)
+                    continue;
+                Cells.Add(X, S.Y[Cur][i], S.VX[Cur][i], S.VY[Cur][i], i);
+                if (OwnerOf(X) == W)
+                    Owned.push_back(i);
+            }
+            Cells.Build();
+            Boid B;
+            for (const size_t i : Owned)
+            {
+                B.Position = Vec2D(S.X[Cur][i], S.Y[Cur][i]);
+                B.Velocity = Vec2D(S.VX[Cur][i], S.VY[Cur][i]);
+                B.BoidID = i;
+                Vec2D RelCOM, RelCOV, Sep;
+                size_t NumCloseby = 0;
+                Cells.Plan(B.Position, B.BoidID, RelCOM, RelCOV, Sep, NumCloseby);
+                B.SetForces(RelCOM, RelCOV, Sep, NumCloseby);
+                B.Move(Params.DeltaTime);
+                S.X[Next][i] = B.Position[0];
+                S.Y[Next][i] = B.Position[1];
+                S.VX[Next][i] = B.Velocity[0];
+                S.VY[Next][i] = B.Velocity[1];
+            }
+            S.Done[W].Value.store(T + 1, std::memory_order_release);
+        }
+    }
+
+    pid_t Spawn(const size_t W)
+    {
+        const pid_t Parent = getpid();
+        const pid_t PID = fork();
+        if (PID == 0)
+        {
+            // die with the parent (instead of spinning in its barriers forever)
+            if (prctl(PR_SET_PDEATHSIG, SIGKILL) != 0 || getppid() != Parent)
+                _exit(1); // (the parent already died before we asked)
+            Work(W);
+            _exit(0); // (skip the parent's atexit handlers & buffers)
+        }
+        return PID;
+    }
+
+    // (returns false if a worker had to be given up on)
+    bool Simulate()
+    {
+        const auto Start = std::chrono::system_clock::now();
+        std::vector<pid_t> Workers(NumWorkers);
+        for (size_t w = 0; w < NumWorkers; w++)
+        {
+            Workers[w] = Spawn(w);
+        }
+        // restart any worker that dies until they have all finished
+        std::vector<size_t> Restarts(NumWorkers, 0);
+        size_t NumFinished = 0;
+        while (NumFinished < NumWorkers)
+        {
+            int Status;
+            const pid_t PID = waitpid(-1, &Status, 0);
+            if (PID < 0)
+                break;
+            const size_t W = std::find(Workers.begin(), Workers.end(), PID) - Workers.begin();
+            if (W == NumWorkers)
+                continue;
+            if (WIFEXITED(Status) && WEXITSTATUS(Status) == 0)
+            {
+                NumFinished++;
+                continue;
+            }
+            std::cout << "Worker " << W << " died ("
+                      << (WIFSIGNALED(Status) ? strsignal(WTERMSIG(Status)) : "exit " + std::to_string(WEXITSTATUS(Status)))
+                      << ") after " << S.Done[W].Value.load() << " ticks";
+            if (Restarts[W] == MaxRestarts)
+            {
+                std::cout << ", giving up after " << MaxRestarts << " restarts" << std::endl;
+                Workers[W] = -1;
+                KillAll(Workers);
+                return false;
+            }
+            std::cout << ", restarting it" << std::endl;
+            Workers[W] = Spawn(W);
+            Restarts[W]++;
+            NumRestarts++;
+        }
+        std::chrono::duration<double> ElapsedTime = std::chrono::system_clock::now() - Start;
+        std::cout << "Finished simulation! Took " << ElapsedTime.count() << "s" << std::endl;
+        std::cout << "Restarted " << NumRestarts << " workers" << std::endl;
+        std::cout.precision(12);
+        std::cout << "Boid position checksum: " << PositionChecksum() << std::endl;
+        std::cout.precision(6);
+        return true;
+    }
+
+    void KillAll(const std::vector<pid_t> &Workers) const
+    {
+        // (the others would wait on the given up worker's ticks forever)
+        for (const pid_t PID : Workers)
+        {
+            if (PID > 0)
+                kill(PID, SIGKILL);
+        }
+        while (waitpid(-1, nullptr, 0) > 0)
+            ; // reap them all
+    }
+
+    double PositionChecksum() const
+    {
+        // (summed in BoidID order, like MpiSimulator's)
+        const size_t Last = Params.NumIterations % 2;
+        double Sum = 0;
+        for (size_t i = 0; i < Params.NumBoids; i++)
+        {
+            Sum += double(S.X[Last][i]) + double(S.Y[Last][i]);
+        }
+        return Sum;
+    }
+};
+
+// declaring static variables
+SimulatorParamsStruct Simulator::Params;
+const size_t Simulator::MaxRestarts;
+ImageParamsStruct Image::Params;
+TracerParamsStruct Tracer::Params;
+
+// global params struct
+ParamsStruct GlobalParams;
+
+int main(int argc, char *argv[])
+{
+    std::srand(0); // consistent seed
+    if (argc == 1)
+    {
+        ParseParams("params/params.ini");
+    }
+    else
+    {
+        const std::string ParamFile(argv[1]);
+        ParseParams("params/" + ParamFile);
+    }
+    Simulator Sim;
+    if (!Sim.Init())
+        return 1;
+    return Sim.Simulate() ? 0 : 1;
+}